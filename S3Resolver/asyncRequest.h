@@ -0,0 +1,38 @@
+#ifndef S3_ASYNC_REQUEST_H
+#define S3_ASYNC_REQUEST_H
+
+#include <atomic>
+
+namespace usd_s3 {
+    // Order in which queued requests are served, foreground first
+    enum class Priority {
+        FOREGROUND,     // loads a caller waits for
+        BACKGROUND,     // prefetches of assets that will be needed
+        SPECULATIVE,    // prefetches of dependencies found in fetched layers
+        COUNT
+    };
+
+    constexpr int PRIORITY_COUNT = static_cast<int>(Priority::COUNT);
+
+    // Cancels the asynchronous requests it is passed to. Requests that are
+    // still queued are dropped, their futures hold an empty path or false,
+    // requests that have started run to completion.
+    class CancelToken {
+    public:
+        CancelToken() : cancelled(false) {
+        }
+
+        void cancel() {
+            cancelled = true;
+        }
+
+        bool is_cancelled() const {
+            return cancelled;
+        }
+
+    private:
+        std::atomic<bool> cancelled;
+    };
+}
+
+#endif // S3_ASYNC_REQUEST_H
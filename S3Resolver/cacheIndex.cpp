@@ -0,0 +1,438 @@
+#include "cacheIndex.h"
+#include "debugCodes.h"
+
+#include <pxr/base/tf/diagnosticLite.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+namespace {
+    constexpr char FILE_MAGIC[8] = {'U', 'S', 'D', 'S', '3', 'I', 'X', '1'};
+    constexpr uint32_t RECORD_MAGIC = 0x52335355;  // "US3R"
+    constexpr uint32_t FLAG_PINNED = 1;
+    constexpr uint32_t FLAG_REMOVED = 2;
+
+    // Don't bother compacting small indices
+    constexpr size_t COMPACT_MIN_RECORDS = 1024;
+
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+    };
+
+    // A record is this header followed by the key, version id, etag and
+    // local path strings, padded to 8 bytes
+    struct RecordHeader {
+        uint32_t magic;
+        uint32_t size;
+        uint64_t key_hash;
+        double last_modified;
+        double validated;
+        uint64_t object_size;
+        uint32_t flags;
+        uint32_t checksum;          // of the strings
+        uint16_t key_length;
+        uint16_t version_length;
+        uint16_t etag_length;
+        uint16_t path_length;
+    };
+
+    // FNV-1a
+    uint64_t hash_bytes(const char* data, size_t length, uint64_t hash = 14695981039346656037ULL) {
+        for (size_t i = 0; i < length; ++i) {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    // Returns the header of a valid record at offset, or nullptr for a
+    // torn or corrupt record
+    const RecordHeader* read_record(const char* data, size_t size, size_t offset) {
+        if (offset + sizeof(RecordHeader) > size) {
+            return nullptr;
+        }
+        const auto* header = reinterpret_cast<const RecordHeader*>(data + offset);
+        const size_t strings_length = size_t(header->key_length) + header->version_length +
+            header->etag_length + header->path_length;
+        if (header->magic != RECORD_MAGIC ||
+                header->size < sizeof(RecordHeader) + strings_length ||
+                offset + header->size > size) {
+            return nullptr;
+        }
+        const char* strings = data + offset + sizeof(RecordHeader);
+        if (static_cast<uint32_t>(hash_bytes(strings, strings_length)) != header->checksum) {
+            return nullptr;
+        }
+        return header;
+    }
+
+    std::vector<char> make_record(const usd_s3::IndexRecord& record, uint32_t flags) {
+        RecordHeader header;
+        std::memset(&header, 0, sizeof(header));
+        header.magic = RECORD_MAGIC;
+        header.key_hash = hash_bytes(record.key.data(), record.key.size());
+        header.last_modified = record.last_modified;
+        header.validated = record.validated;
+        header.object_size = record.size;
+        header.flags = flags | (record.is_pinned ? FLAG_PINNED : 0);
+        header.key_length = static_cast<uint16_t>(record.key.size());
+        header.version_length = static_cast<uint16_t>(record.version_id.size());
+        header.etag_length = static_cast<uint16_t>(record.etag.size());
+        header.path_length = static_cast<uint16_t>(record.local_path.size());
+
+        std::string strings = record.key + record.version_id + record.etag + record.local_path;
+        header.checksum = static_cast<uint32_t>(hash_bytes(strings.data(), strings.size()));
+        header.size = static_cast<uint32_t>((sizeof(RecordHeader) + strings.size() + 7) & ~size_t(7));
+
+        std::vector<char> buffer(header.size, 0);
+        std::memcpy(buffer.data(), &header, sizeof(header));
+        std::memcpy(buffer.data() + sizeof(header), strings.data(), strings.size());
+        return buffer;
+    }
+
+    usd_s3::IndexRecord to_index_record(const RecordHeader* header) {
+        const char* strings = reinterpret_cast<const char*>(header) + sizeof(RecordHeader);
+        usd_s3::IndexRecord record;
+        record.key.assign(strings, header->key_length);
+        strings += header->key_length;
+        record.version_id.assign(strings, header->version_length);
+        strings += header->version_length;
+        record.etag.assign(strings, header->etag_length);
+        strings += header->etag_length;
+        record.local_path.assign(strings, header->path_length);
+        record.last_modified = header->last_modified;
+        record.validated = header->validated;
+        record.size = header->object_size;
+        record.is_pinned = (header->flags & FLAG_PINNED) != 0;
+        return record;
+    }
+
+    // Holds a read-write lock, shared or exclusive, for a scope
+    class ScopedRWLock {
+    public:
+        ScopedRWLock(pthread_rwlock_t& rwlock, bool exclusive) : rwlock(rwlock) {
+            if (exclusive) {
+                pthread_rwlock_wrlock(&rwlock);
+            } else {
+                pthread_rwlock_rdlock(&rwlock);
+            }
+        }
+        ~ScopedRWLock() {
+            pthread_rwlock_unlock(&rwlock);
+        }
+        ScopedRWLock(const ScopedRWLock&) = delete;
+        ScopedRWLock& operator=(const ScopedRWLock&) = delete;
+
+    private:
+        pthread_rwlock_t& rwlock;
+    };
+
+    bool write_all(int fd, const char* data, size_t size) {
+        while (size > 0) {
+            const ssize_t written = ::write(fd, data, size);
+            if (written < 0) {
+                return false;
+            }
+            data += written;
+            size -= written;
+        }
+        return true;
+    }
+}
+
+namespace usd_s3 {
+    CacheIndex::CacheIndex()
+        : fd(-1), file_device(0), file_inode(0), data(nullptr), mapped_size(0), scanned_size(0), record_count(0) {
+        pthread_rwlock_init(&rwlock, nullptr);
+    }
+
+    CacheIndex::~CacheIndex() {
+        close();
+        pthread_rwlock_destroy(&rwlock);
+    }
+
+    // Open the index of a cache directory and read all its records, compacting it
+    // if most of them are outdated. This is the only time the whole index is read.
+    bool CacheIndex::open(const std::string& cache_dir) {
+        ScopedRWLock lock(rwlock, true);
+        file_path = cache_dir + "/" + CACHE_INDEX_NAME;
+        fd = ::open(file_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+        if (fd < 0) {
+            TF_DEBUG(S3_DBG).Msg("S3: failed to open the cache index %s\n", file_path.c_str());
+            return false;
+        }
+        lock_file(LOCK_EX);
+        struct stat file_stat;
+        const bool has_stat = fstat(fd, &file_stat) == 0;
+        if (has_stat) {
+            file_device = static_cast<uint64_t>(file_stat.st_dev);
+            file_inode = static_cast<uint64_t>(file_stat.st_ino);
+        }
+        if (has_stat && file_stat.st_size == 0) {
+            FileHeader header;
+            std::memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+            header.version = 1;
+            header.reserved = 0;
+            write_all(fd, reinterpret_cast<const char*>(&header), sizeof(header));
+        }
+        unlock_file();
+        map();
+        if (mapped_size < sizeof(FileHeader) || std::memcmp(data, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0) {
+            TF_DEBUG(S3_DBG).Msg("S3: ignoring invalid cache index %s\n", file_path.c_str());
+            unmap();
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+        scanned_size = sizeof(FileHeader);
+        scan();
+        compact();
+        TF_DEBUG(S3_DBG).Msg("S3: opened cache index %s, %zu records\n", file_path.c_str(), offsets.size());
+        return true;
+    }
+
+    void CacheIndex::close() {
+        ScopedRWLock lock(rwlock, true);
+        unmap();
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+        offsets.clear();
+        record_count = 0;
+    }
+
+    // Look up the record of a key, with latest set the records appended by
+    // other processes since the last scan are read first. A miss reads them
+    // only if the file changed, lookups of other threads wait for that.
+    bool CacheIndex::find(const std::string& key, IndexRecord& record, bool latest) {
+        const uint64_t key_hash = hash_bytes(key.data(), key.size());
+        {
+            ScopedRWLock lock(rwlock, false);
+            if (fd < 0) {
+                return false;
+            }
+            if (!latest || !has_changed()) {
+                const LookupResult result = lookup(key_hash, key, record);
+                if (result != LookupResult::UNKNOWN || latest || !has_changed()) {
+                    return result == LookupResult::FOUND;
+                }
+            }
+        }
+        ScopedRWLock lock(rwlock, true);
+        if (fd < 0) {
+            return false;
+        }
+        scan();
+        return lookup(key_hash, key, record) == LookupResult::FOUND;
+    }
+
+    void CacheIndex::store(const IndexRecord& record) {
+        ScopedRWLock lock(rwlock, true);
+        append(record, false);
+    }
+
+    void CacheIndex::remove(const std::string& key) {
+        ScopedRWLock lock(rwlock, true);
+        IndexRecord record{key, "", "", "", 0.0, 0.0, 0, false};
+        append(record, true);
+    }
+
+    // All objects in the index, used to seed the cache accounting
+    std::vector<IndexRecord> CacheIndex::records() {
+        ScopedRWLock lock(rwlock, true);
+        std::vector<IndexRecord> result;
+        if (fd < 0) {
+            return result;
+        }
+        scan();
+        result.reserve(offsets.size());
+        for (const auto& offset : offsets) {
+            const auto* header = reinterpret_cast<const RecordHeader*>(data + offset.second);
+            if (!(header->flags & FLAG_REMOVED)) {
+                result.push_back(to_index_record(header));
+            }
+        }
+        return result;
+    }
+
+    // Check if records were appended, or the file was replaced, since it was mapped
+    bool CacheIndex::has_changed() const {
+        struct stat path_stat;
+        return stat(file_path.c_str(), &path_stat) == 0 &&
+            (static_cast<size_t>(path_stat.st_size) != mapped_size ||
+             static_cast<uint64_t>(path_stat.st_ino) != file_inode ||
+             static_cast<uint64_t>(path_stat.st_dev) != file_device);
+    }
+
+    // Find the latest scanned record of a key, the caller holds the read-write lock
+    CacheIndex::LookupResult CacheIndex::lookup(uint64_t key_hash, const std::string& key,
+            IndexRecord& record) const {
+        const auto it = offsets.find(key_hash);
+        if (it == offsets.end()) {
+            return LookupResult::UNKNOWN;
+        }
+        const auto* header = reinterpret_cast<const RecordHeader*>(data + it->second);
+        if (header->flags & FLAG_REMOVED) {
+            return LookupResult::NOT_FOUND;
+        }
+        record = to_index_record(header);
+        // or the record of another key with the same hash
+        return record.key == key ? LookupResult::FOUND : LookupResult::NOT_FOUND;
+    }
+
+    // Map the whole file, returns false if the size didn't change or mapping failed
+    bool CacheIndex::map() {
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) != 0) {
+            return false;
+        }
+        const size_t size = static_cast<size_t>(file_stat.st_size);
+        if (size == mapped_size) {
+            return false;
+        }
+        unmap();
+        if (size == 0) {
+            return false;
+        }
+        void* address = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (address == MAP_FAILED) {
+            return false;
+        }
+        data = static_cast<const char*>(address);
+        mapped_size = size;
+        return true;
+    }
+
+    void CacheIndex::unmap() {
+        if (data != nullptr) {
+            munmap(const_cast<char*>(data), mapped_size);
+        }
+        data = nullptr;
+        mapped_size = 0;
+    }
+
+    // Take the advisory lock on the index file, reopening it first
+    // when another process replaced it by compacting
+    void CacheIndex::lock_file(int operation) {
+        for (;;) {
+            while (flock(fd, operation) != 0 && errno == EINTR) {}
+            struct stat path_stat, fd_stat;
+            if (stat(file_path.c_str(), &path_stat) != 0 || fstat(fd, &fd_stat) != 0 ||
+                    (path_stat.st_ino == fd_stat.st_ino && path_stat.st_dev == fd_stat.st_dev)) {
+                return;
+            }
+            flock(fd, LOCK_UN);
+            const int new_fd = ::open(file_path.c_str(), O_RDWR | O_CLOEXEC);
+            if (new_fd < 0) {
+                // keep using the old file, it is still a consistent index
+                while (flock(fd, operation) != 0 && errno == EINTR) {}
+                return;
+            }
+            TF_DEBUG(S3_DBG).Msg("S3: reopening replaced cache index %s\n", file_path.c_str());
+            unmap();
+            ::close(fd);
+            fd = new_fd;
+            struct stat new_stat;
+            if (fstat(fd, &new_stat) == 0) {
+                file_device = static_cast<uint64_t>(new_stat.st_dev);
+                file_inode = static_cast<uint64_t>(new_stat.st_ino);
+            }
+            offsets.clear();
+            record_count = 0;
+            scanned_size = sizeof(FileHeader);
+        }
+    }
+
+    void CacheIndex::unlock_file() {
+        flock(fd, LOCK_UN);
+    }
+
+    // Add the records after scanned_size to the lookup table, the caller holds the file lock
+    void CacheIndex::scan_locked() {
+        map();
+        size_t offset = scanned_size;
+        while (const RecordHeader* header = read_record(data, mapped_size, offset)) {
+            offsets[header->key_hash] = offset;
+            offset += header->size;
+            ++record_count;
+        }
+        scanned_size = offset;
+    }
+
+    void CacheIndex::scan() {
+        // appends happen under an exclusive lock, don't read a half written record
+        lock_file(LOCK_SH);
+        scan_locked();
+        unlock_file();
+    }
+
+    // Rewrite the index with only the latest record of each key
+    // when most of its records are outdated
+    void CacheIndex::compact() {
+        if (record_count < COMPACT_MIN_RECORDS || record_count < 2 * offsets.size()) {
+            return;
+        }
+        lock_file(LOCK_EX);
+        scan_locked();
+        if (record_count < COMPACT_MIN_RECORDS || record_count < 2 * offsets.size()) {
+            // another process compacted it already
+            unlock_file();
+            return;
+        }
+        const std::string temp_path = file_path + ".tmp." + std::to_string(getpid());
+        const int temp_fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        bool success = temp_fd >= 0 && write_all(temp_fd, data, sizeof(FileHeader));
+        for (const auto& offset : offsets) {
+            const auto* header = reinterpret_cast<const RecordHeader*>(data + offset.second);
+            if (success && !(header->flags & FLAG_REMOVED)) {
+                success = write_all(temp_fd, data + offset.second, header->size);
+            }
+        }
+        if (temp_fd >= 0) {
+            ::close(temp_fd);
+        }
+        if (!success || rename(temp_path.c_str(), file_path.c_str()) != 0) {
+            std::remove(temp_path.c_str());
+            unlock_file();
+            return;
+        }
+        TF_DEBUG(S3_DBG).Msg("S3: compacted cache index from %zu to %zu records\n",
+            record_count, offsets.size());
+        unlock_file();
+        // switch to the compacted file
+        scan();
+    }
+
+    bool CacheIndex::append(const IndexRecord& record, bool removed) {
+        if (fd < 0) {
+            return false;
+        }
+        const std::vector<char> buffer = make_record(record, removed ? FLAG_REMOVED : 0);
+        lock_file(LOCK_EX);
+        scan_locked();
+        bool success = true;
+        if (scanned_size < mapped_size) {
+            // a crashed writer left a torn record at the end, drop it
+            TF_DEBUG(S3_DBG).Msg("S3: truncating torn cache index record at %zu\n", scanned_size);
+            success = ftruncate(fd, static_cast<off_t>(scanned_size)) == 0;
+        }
+        success = success && lseek(fd, static_cast<off_t>(scanned_size), SEEK_SET) >= 0 &&
+            write_all(fd, buffer.data(), buffer.size());
+        scan_locked();
+        unlock_file();
+        return success;
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef S3_CACHE_INDEX_H
+#define S3_CACHE_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <pthread.h>
+
+namespace usd_s3 {
+    constexpr const char CACHE_INDEX_NAME[] = ".usd_s3_index";
+
+    // An object in the local cache as recorded in the persistent index
+    struct IndexRecord {
+        std::string key;            // parsed path, e.g. bucket/object.usd?versionId=abc123
+        std::string version_id;
+        std::string etag;
+        std::string local_path;
+        double last_modified;       // date last modified on S3
+        double validated;           // time the local copy was last known to be current
+        size_t size;
+        bool is_pinned;
+    };
+
+    // Persistent index of the objects in a cache directory.
+    //
+    // The index is an append-only log of records in the cache directory,
+    // the last record of a key wins. It is memory mapped, scanned and compacted
+    // on open, so a lookup only hashes its key and lookups of several threads
+    // run concurrently. Several processes can share the index: appends take an
+    // exclusive advisory lock and every process picks up the records of the
+    // others when a lookup misses and the file has changed since it was read,
+    // which costs a single stat otherwise.
+    class CacheIndex {
+    public:
+        CacheIndex();
+        ~CacheIndex();
+
+        bool open(const std::string& cache_dir);
+        void close();
+
+        bool find(const std::string& key, IndexRecord& record, bool latest = false);
+        void store(const IndexRecord& record);
+        void remove(const std::string& key);
+        std::vector<IndexRecord> records();
+
+    private:
+        bool map();
+        void unmap();
+        void lock_file(int operation);
+        void unlock_file();
+        void scan_locked();
+        void scan();
+        void compact();
+        enum class LookupResult { FOUND, NOT_FOUND, UNKNOWN };   // UNKNOWN if the key has no record yet
+
+        bool has_changed() const;
+        LookupResult lookup(uint64_t key_hash, const std::string& key, IndexRecord& record) const;
+        bool append(const IndexRecord& record, bool removed);
+
+        // lookups share it, everything that maps or scans the file takes it exclusively
+        mutable pthread_rwlock_t rwlock;
+        std::string file_path;
+        int fd;
+        uint64_t file_device;       // identity of the open file, to notice when it was replaced
+        uint64_t file_inode;
+        const char* data;
+        size_t mapped_size;
+        size_t scanned_size;        // records up to here are in offsets
+        size_t record_count;
+        std::unordered_map<uint64_t, size_t> offsets;   // key hash to record offset
+    };
+}
+
+#endif // S3_CACHE_INDEX_H
@@ -0,0 +1,250 @@
+#include "cacheManager.h"
+#include "cacheIndex.h"
+#include "debugCodes.h"
+
+#include <pxr/base/tf/diagnosticLite.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <sys/stat.h>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+namespace {
+    // Objects used more recently than this are not evicted
+    constexpr std::chrono::seconds MIN_EVICTION_AGE(5);
+    // How often the janitor retries when every object over the budget is in use
+    constexpr std::chrono::seconds RETRY_INTERVAL(1);
+}
+
+namespace usd_s3 {
+    CacheManager::CacheManager()
+        : budget(0), size(0), evictions(0), is_running(false) {
+    }
+
+    CacheManager::~CacheManager() {
+        stop();
+    }
+
+    // Start the janitor thread, a budget of 0 leaves the cache unbounded
+    void CacheManager::start(size_t cache_budget, CacheIndex& index, EvictFunction evict_function) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (is_running || cache_budget == 0) {
+            return;
+        }
+        budget = cache_budget;
+        evict = evict_function;
+        is_running = true;
+        janitor = std::thread(&CacheManager::run, this, &index);
+    }
+
+    void CacheManager::stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            is_running = false;
+        }
+        cond.notify_all();
+        if (janitor.joinable()) {
+            janitor.join();
+        }
+    }
+
+    bool CacheManager::is_enabled() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return budget > 0;
+    }
+
+    // Identity of the file at a local path, hard links to one blob share it.
+    // A file that can't be found is charged on its own.
+    std::string CacheManager::get_content_id(const std::string& key, const std::string& local_path) {
+        struct stat file_stat;
+        if (stat(local_path.c_str(), &file_stat) != 0) {
+            return "key:" + key;
+        }
+        return std::to_string(file_stat.st_dev) + ":" + std::to_string(file_stat.st_ino);
+    }
+
+    // Charge the size of an entry if it is the first link to its content
+    void CacheManager::add_link(const Entry& entry) {
+        if (++links[entry.content] == 1) {
+            size += entry.size;
+        }
+    }
+
+    // Release the size of an entry if it was the last link to its content
+    void CacheManager::remove_link(const Entry& entry) {
+        auto it = links.find(entry.content);
+        if (it != links.end() && --it->second == 0) {
+            size -= entry.size;
+            links.erase(it);
+        }
+    }
+
+    // Account for an object that landed in the cache
+    void CacheManager::insert(const std::string& key, const std::string& local_path, size_t object_size) {
+        if (!is_enabled()) {
+            return;
+        }
+        const std::string content = get_content_id(key, local_path);
+        std::unique_lock<std::mutex> lock(mutex);
+        auto it = entries.find(key);
+        if (it == entries.end()) {
+            lru.push_front(key);
+            it = entries.insert(std::make_pair(key,
+                Entry{local_path, content, object_size, Clock::now(), lru.begin(), false})).first;
+        } else {
+            remove_link(it->second);
+            lru.splice(lru.begin(), lru, it->second.position);
+            it->second.local_path = local_path;
+            it->second.content = content;
+            it->second.size = object_size;
+            it->second.used = Clock::now();
+            it->second.is_evicting = false;
+        }
+        add_link(it->second);
+        const bool over_budget = size > budget;
+        lock.unlock();
+        if (over_budget) {
+            cond.notify_one();
+        }
+    }
+
+    // Mark an object as recently used
+    void CacheManager::touch(const std::string& key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            lru.splice(lru.begin(), lru, it->second.position);
+            it->second.used = Clock::now();
+        }
+    }
+
+    // Stop accounting for an object that was removed from the cache
+    void CacheManager::erase(const std::string& key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            remove_link(it->second);
+            lru.erase(it->second.position);
+            entries.erase(it);
+        }
+    }
+
+    void CacheManager::pin(const std::string& key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++pins[key];
+    }
+
+    void CacheManager::unpin(const std::string& key) {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto it = pins.find(key);
+        if (it != pins.end() && --it->second == 0) {
+            pins.erase(it);
+        }
+        const bool over_budget = budget > 0 && size > budget;
+        lock.unlock();
+        if (over_budget) {
+            cond.notify_one();
+        }
+    }
+
+    size_t CacheManager::get_size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return size;
+    }
+
+    size_t CacheManager::get_budget() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return budget;
+    }
+
+    size_t CacheManager::get_evictions() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return evictions;
+    }
+
+    void CacheManager::run(CacheIndex* index) {
+        // reading the index can take a while, keep it off the thread starting the resolver
+        seed(*index);
+        std::unique_lock<std::mutex> lock(mutex);
+        while (is_running) {
+            if (size <= budget) {
+                cond.wait(lock);
+            } else if (!evict_next(lock)) {
+                cond.wait_for(lock, RETRY_INTERVAL);
+            }
+        }
+    }
+
+    // Account for the objects fetched by earlier processes, oldest last
+    void CacheManager::seed(CacheIndex& index) {
+        std::vector<IndexRecord> records = index.records();
+        std::sort(records.begin(), records.end(), [](const IndexRecord& a, const IndexRecord& b) {
+            return a.validated > b.validated;
+        });
+        std::vector<std::string> contents;
+        contents.reserve(records.size());
+        for (const auto& record : records) {
+            contents.push_back(get_content_id(record.key, record.local_path));
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < records.size(); ++i) {
+            const IndexRecord& record = records[i];
+            if (entries.find(record.key) != entries.end()) {
+                continue;
+            }
+            lru.push_back(record.key);
+            const auto it = entries.insert(std::make_pair(record.key,
+                Entry{record.local_path, contents[i], record.size, Clock::time_point(), std::prev(lru.end()), false}));
+            add_link(it.first->second);
+        }
+        TF_DEBUG(S3_DBG).Msg("S3: cache holds %zu objects in %zu files, %zu of %zu bytes\n",
+            entries.size(), links.size(), size, budget);
+    }
+
+    // Evict the least recently used object that is not in use,
+    // returns false if there is no such object
+    bool CacheManager::evict_next(std::unique_lock<std::mutex>& lock) {
+        const auto now = Clock::now();
+        auto candidate = entries.end();
+        for (auto it = lru.rbegin(); it != lru.rend(); ++it) {
+            auto entry = entries.find(*it);
+            if (!entry->second.is_evicting && pins.find(*it) == pins.end() &&
+                    now - entry->second.used >= MIN_EVICTION_AGE) {
+                candidate = entry;
+                break;
+            }
+        }
+        if (candidate == entries.end()) {
+            return false;
+        }
+
+        // evict without holding the lock, the callback waits for fetches of the object
+        const std::string key = candidate->first;
+        const std::string local_path = candidate->second.local_path;
+        candidate->second.is_evicting = true;
+        lock.unlock();
+        const bool evicted = evict(key, local_path);
+        lock.lock();
+
+        auto it = entries.find(key);
+        if (it == entries.end() || !it->second.is_evicting) {
+            // erased or fetched again in the meantime
+            return true;
+        }
+        if (evicted) {
+            TF_DEBUG(S3_DBG).Msg("S3: evicted %s, %zu bytes\n", key.c_str(), it->second.size);
+            remove_link(it->second);
+            lru.erase(it->second.position);
+            entries.erase(it);
+            ++evictions;
+        } else {
+            // in use, try it again later
+            it->second.is_evicting = false;
+            it->second.used = now;
+            lru.splice(lru.begin(), lru, it->second.position);
+        }
+        return true;
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef S3_CACHE_MANAGER_H
+#define S3_CACHE_MANAGER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace usd_s3 {
+    class CacheIndex;
+
+    // Keeps the local cache within a byte budget.
+    //
+    // The manager tracks the size and last use of every object in the cache
+    // in memory, seeded from the cache index, and evicts the least recently
+    // used objects on a background thread once the budget is exceeded.
+    // Objects that are pinned (open) are never evicted, neither are objects
+    // used in the last few seconds, so a fetched file survives until USD opens it.
+    // Objects whose local paths are hard links to the same blob are charged
+    // once, their bytes count until the last of them is evicted.
+    class CacheManager {
+    public:
+        // Removes an object from the cache, returns false if the object is in use
+        using EvictFunction = std::function<bool(const std::string& key, const std::string& local_path)>;
+
+        CacheManager();
+        ~CacheManager();
+
+        void start(size_t budget, CacheIndex& index, EvictFunction evict);
+        void stop();
+
+        bool is_enabled() const;
+        void insert(const std::string& key, const std::string& local_path, size_t size);
+        void touch(const std::string& key);
+        void erase(const std::string& key);
+        void pin(const std::string& key);
+        void unpin(const std::string& key);
+
+        size_t get_size() const;
+        size_t get_budget() const;
+        size_t get_evictions() const;
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        struct Entry {
+            std::string local_path;
+            std::string content;        // file identity, see get_content_id
+            size_t size;
+            Clock::time_point used;
+            std::list<std::string>::iterator position;
+            bool is_evicting;
+        };
+
+        static std::string get_content_id(const std::string& key, const std::string& local_path);
+        void add_link(const Entry& entry);
+        void remove_link(const Entry& entry);
+
+        void run(CacheIndex* index);
+        void seed(CacheIndex& index);
+        bool evict_next(std::unique_lock<std::mutex>& lock);
+
+        mutable std::mutex mutex;
+        std::condition_variable cond;
+        std::thread janitor;
+        EvictFunction evict;
+        size_t budget;
+        size_t size;
+        size_t evictions;
+        bool is_running;
+        std::list<std::string> lru;     // most recently used first
+        std::unordered_map<std::string, Entry> entries;
+        std::unordered_map<std::string, size_t> links;  // content to number of entries
+        std::unordered_map<std::string, size_t> pins;   // key to number of open assets
+    };
+}
+
+#endif // S3_CACHE_MANAGER_H
@@ -0,0 +1,75 @@
+#include "compressedAsset.h"
+#include "debugCodes.h"
+#include "metrics.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+S3CompressedAsset::S3CompressedAsset(
+    FILE* file,
+    usd_s3::Encoding encoding,
+    const std::string& path)
+    : _file(file)
+    , _encoding(encoding)
+    , _path(path)
+    , _isDecoded(false)
+    , _size(0)
+{
+}
+
+S3CompressedAsset::~S3CompressedAsset()
+{
+    fclose(_file);
+}
+
+bool S3CompressedAsset::_Decode()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_isDecoded) {
+        return static_cast<bool>(_buffer);
+    }
+    _isDecoded = true;
+    usd_s3::ScopedTimer timer(usd_s3::Timer::DECOMPRESS, &_path);
+    std::vector<char> content;
+    if (!usd_s3::decompress_file(_encoding, fileno(_file), content)) {
+        TF_DEBUG(S3_DBG).Msg("S3: failed to decompress %s\n", _path.c_str());
+        return false;
+    }
+    _size = content.size();
+    std::shared_ptr<char> buffer(new char[std::max<size_t>(_size, 1)], std::default_delete<char[]>());
+    std::memcpy(buffer.get(), content.data(), _size);
+    _buffer = buffer;
+    usd_s3::add_metric(usd_s3::Counter::DECOMPRESSED_BYTES, static_cast<int64_t>(_size));
+    TF_DEBUG(S3_DBG).Msg("S3: decompressed %s, %zu bytes\n", _path.c_str(), _size);
+    return true;
+}
+
+size_t S3CompressedAsset::GetSize()
+{
+    return _Decode() ? _size : 0;
+}
+
+std::shared_ptr<const char> S3CompressedAsset::GetBuffer()
+{
+    return _Decode() ? _buffer : nullptr;
+}
+
+size_t S3CompressedAsset::Read(void* buffer, size_t count, size_t offset)
+{
+    if (!_Decode() || offset >= _size) {
+        return 0;
+    }
+    count = std::min(count, _size - offset);
+    std::memcpy(buffer, _buffer.get() + offset, count);
+    return count;
+}
+
+std::pair<FILE*, size_t> S3CompressedAsset::GetFileUnsafe()
+{
+    return std::make_pair(nullptr, 0);
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
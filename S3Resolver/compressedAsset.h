@@ -0,0 +1,53 @@
+#ifndef S3_COMPRESSED_ASSET_H
+#define S3_COMPRESSED_ASSET_H
+
+#include "compression.h"
+
+#include <pxr/pxr.h>
+#include <pxr/usd/ar/asset.h>
+
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/// \class S3CompressedAsset
+///
+/// An ArAsset for a compressed file in the local cache, an object stored with
+/// a Content-Encoding or a layer compressed by the cache. The file is decoded
+/// into memory on first access, USD sees the decoded content.
+///
+class S3CompressedAsset : public ArAsset
+{
+public:
+    S3CompressedAsset(
+        FILE* file,
+        usd_s3::Encoding encoding,
+        const std::string& path);
+    ~S3CompressedAsset() override;
+
+    size_t GetSize() override;
+    std::shared_ptr<const char> GetBuffer() override;
+    size_t Read(void* buffer, size_t count, size_t offset) override;
+
+    /// The local file holds the compressed content, always returns (nullptr, 0).
+    std::pair<FILE*, size_t> GetFileUnsafe() override;
+
+private:
+    bool _Decode();
+
+    FILE* const _file;
+    const usd_s3::Encoding _encoding;
+    const std::string _path;
+
+    std::mutex _mutex;
+    bool _isDecoded;
+    std::shared_ptr<const char> _buffer;
+    size_t _size;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // S3_COMPRESSED_ASSET_H
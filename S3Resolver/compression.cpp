@@ -0,0 +1,211 @@
+#include "compression.h"
+
+#include <zlib.h>
+#ifdef USD_S3_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+    constexpr size_t CHUNK_SIZE = 1 << 16;
+    constexpr unsigned char GZIP_MAGIC[] = {0x1f, 0x8b};
+    constexpr unsigned char ZSTD_MAGIC[] = {0x28, 0xb5, 0x2f, 0xfd};
+    // window bits of a gzip stream for zlib
+    constexpr int GZIP_WINDOW_BITS = 15 + 16;
+
+    bool starts_with(const char* data, size_t size, const unsigned char* magic, size_t magic_size) {
+        return size >= magic_size && std::memcmp(data, magic, magic_size) == 0;
+    }
+}
+
+namespace usd_s3 {
+    Encoding parse_content_encoding(const std::string& content_encoding) {
+        if (content_encoding == "gzip" || content_encoding == "x-gzip") {
+            return Encoding::GZIP;
+        }
+        if (content_encoding == "zstd") {
+            return Encoding::ZSTD;
+        }
+        return Encoding::IDENTITY;
+    }
+
+    Encoding detect_encoding(const char* data, size_t size) {
+        if (starts_with(data, size, GZIP_MAGIC, sizeof(GZIP_MAGIC))) {
+            return Encoding::GZIP;
+        }
+        if (starts_with(data, size, ZSTD_MAGIC, sizeof(ZSTD_MAGIC))) {
+            return Encoding::ZSTD;
+        }
+        return Encoding::IDENTITY;
+    }
+
+    Encoding detect_file_encoding(int fd) {
+        char magic[sizeof(ZSTD_MAGIC)];
+        const ssize_t count = pread(fd, magic, sizeof(magic), 0);
+        return count > 0 ? detect_encoding(magic, static_cast<size_t>(count)) : Encoding::IDENTITY;
+    }
+
+    bool can_decode(Encoding encoding) {
+#ifdef USD_S3_WITH_ZSTD
+        return true;
+#else
+        return encoding != Encoding::ZSTD;
+#endif
+    }
+
+    struct Decompressor::Impl {
+        Encoding encoding;
+        bool is_done = false;
+        bool is_valid = false;
+        z_stream gzip = {};
+#ifdef USD_S3_WITH_ZSTD
+        ZSTD_DStream* zstd = nullptr;
+#endif
+    };
+
+    Decompressor::Decompressor(Encoding encoding)
+        : impl(new Impl) {
+        impl->encoding = encoding;
+        if (encoding == Encoding::GZIP) {
+            impl->is_valid = inflateInit2(&impl->gzip, GZIP_WINDOW_BITS) == Z_OK;
+        }
+#ifdef USD_S3_WITH_ZSTD
+        if (encoding == Encoding::ZSTD) {
+            impl->zstd = ZSTD_createDStream();
+            impl->is_valid = impl->zstd != nullptr && !ZSTD_isError(ZSTD_initDStream(impl->zstd));
+        }
+#endif
+    }
+
+    Decompressor::~Decompressor() {
+        if (impl->encoding == Encoding::GZIP && impl->is_valid) {
+            inflateEnd(&impl->gzip);
+        }
+#ifdef USD_S3_WITH_ZSTD
+        ZSTD_freeDStream(impl->zstd);
+#endif
+        delete impl;
+    }
+
+    bool Decompressor::update(const char* data, size_t size, std::vector<char>& output) {
+        if (!impl->is_valid) {
+            return false;
+        }
+        if (impl->encoding == Encoding::GZIP) {
+            z_stream& stream = impl->gzip;
+            stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+            stream.avail_in = static_cast<uInt>(size);
+            while (stream.avail_in > 0 && !impl->is_done) {
+                const size_t offset = output.size();
+                output.resize(offset + CHUNK_SIZE);
+                stream.next_out = reinterpret_cast<Bytef*>(output.data() + offset);
+                stream.avail_out = static_cast<uInt>(CHUNK_SIZE);
+                const int result = inflate(&stream, Z_NO_FLUSH);
+                output.resize(offset + CHUNK_SIZE - stream.avail_out);
+                if (result == Z_STREAM_END) {
+                    impl->is_done = true;
+                } else if (result != Z_OK && result != Z_BUF_ERROR) {
+                    return false;
+                }
+            }
+            return true;
+        }
+#ifdef USD_S3_WITH_ZSTD
+        if (impl->encoding == Encoding::ZSTD) {
+            ZSTD_inBuffer input = {data, size, 0};
+            while (input.pos < input.size) {
+                const size_t offset = output.size();
+                output.resize(offset + CHUNK_SIZE);
+                ZSTD_outBuffer out = {output.data() + offset, CHUNK_SIZE, 0};
+                const size_t result = ZSTD_decompressStream(impl->zstd, &out, &input);
+                output.resize(offset + out.pos);
+                if (ZSTD_isError(result)) {
+                    return false;
+                }
+                // 0 at the end of a frame, more frames may follow
+                impl->is_done = result == 0;
+            }
+            return true;
+        }
+#endif
+        return false;
+    }
+
+    bool Decompressor::is_done() const {
+        return impl->is_done;
+    }
+
+    bool decompress(Encoding encoding, const char* data, size_t size, std::vector<char>& output) {
+        Decompressor decompressor(encoding);
+        return decompressor.update(data, size, output) && decompressor.is_done();
+    }
+
+    bool decompress_file(Encoding encoding, int fd, std::vector<char>& output) {
+        Decompressor decompressor(encoding);
+        std::vector<char> chunk(CHUNK_SIZE);
+        off_t offset = 0;
+        while (true) {
+            const ssize_t count = pread(fd, chunk.data(), chunk.size(), offset);
+            if (count < 0) {
+                return false;
+            }
+            if (count == 0) {
+                return decompressor.is_done();
+            }
+            if (!decompressor.update(chunk.data(), static_cast<size_t>(count), output)) {
+                return false;
+            }
+            offset += count;
+        }
+    }
+
+    bool compress_file(const std::string& source, const std::string& destination) {
+        std::ifstream input(source.c_str(), std::ios::in | std::ios::binary);
+        gzFile output = gzopen(destination.c_str(), "wb6");
+        if (!input || output == nullptr) {
+            if (output != nullptr) {
+                gzclose(output);
+            }
+            return false;
+        }
+        std::vector<char> chunk(CHUNK_SIZE);
+        bool success = true;
+        while (success && input) {
+            input.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+            const auto count = input.gcount();
+            if (count > 0) {
+                success = gzwrite(output, chunk.data(), static_cast<unsigned>(count)) == static_cast<int>(count);
+            }
+        }
+        success = gzclose(output) == Z_OK && success && input.eof();
+        if (!success) {
+            std::remove(destination.c_str());
+        }
+        return success;
+    }
+
+    bool has_gzip_size(const std::string& path, size_t size) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        // the trailer ends with the content size modulo 2^32, little endian
+        unsigned char trailer[4];
+        const off_t end = lseek(fd, 0, SEEK_END);
+        const bool is_gzip = detect_file_encoding(fd) == Encoding::GZIP;
+        const bool has_trailer = end >= 4 && pread(fd, trailer, sizeof(trailer), end - 4) == sizeof(trailer);
+        close(fd);
+        if (!is_gzip || !has_trailer) {
+            return false;
+        }
+        const uint32_t stored_size = static_cast<uint32_t>(trailer[0]) | (static_cast<uint32_t>(trailer[1]) << 8) |
+            (static_cast<uint32_t>(trailer[2]) << 16) | (static_cast<uint32_t>(trailer[3]) << 24);
+        return stored_size == static_cast<uint32_t>(size);
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef S3_COMPRESSION_H
+#define S3_COMPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace usd_s3 {
+    // Content encodings of compressed objects. zstd is only decoded when the
+    // resolver is built with it, see CMakeLists.txt.
+    enum class Encoding {
+        IDENTITY,
+        GZIP,
+        ZSTD
+    };
+
+    // The encoding of a Content-Encoding header, IDENTITY for anything else
+    Encoding parse_content_encoding(const std::string& content_encoding);
+    // The encoding of compressed content by its magic number, IDENTITY if it isn't compressed
+    Encoding detect_encoding(const char* data, size_t size);
+    // The encoding of an open file by its magic number
+    Encoding detect_file_encoding(int fd);
+    bool can_decode(Encoding encoding);
+
+    // Decodes a compressed stream chunk by chunk
+    class Decompressor {
+    public:
+        explicit Decompressor(Encoding encoding);
+        ~Decompressor();
+        Decompressor(const Decompressor&) = delete;
+        Decompressor& operator=(const Decompressor&) = delete;
+
+        // Decode the next chunk of input and append the output,
+        // returns false if the input is corrupt
+        bool update(const char* data, size_t size, std::vector<char>& output);
+        // Check if the whole stream was decoded
+        bool is_done() const;
+
+    private:
+        struct Impl;
+        Impl* impl;
+    };
+
+    // Decode compressed content in memory
+    bool decompress(Encoding encoding, const char* data, size_t size, std::vector<char>& output);
+    // Decode a compressed file, reading it in chunks
+    bool decompress_file(Encoding encoding, int fd, std::vector<char>& output);
+    // Compress a file with gzip into destination
+    bool compress_file(const std::string& source, const std::string& destination);
+    // Check if a gzip file holds content of the given size, by the size in its trailer
+    bool has_gzip_size(const std::string& path, size_t size);
+}
+
+#endif // S3_COMPRESSION_H
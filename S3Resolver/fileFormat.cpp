@@ -0,0 +1,159 @@
+#include "fileFormat.h"
+#include "debugCodes.h"
+#include "manifest.h"
+
+#include <pxr/base/tf/diagnostic.h>
+#include <pxr/base/tf/registryManager.h>
+#include <pxr/base/tf/type.h>
+#include <pxr/usd/ar/asset.h>
+#include <pxr/usd/ar/packageUtils.h>
+#include <pxr/usd/ar/resolver.h>
+#include <pxr/usd/sdf/layer.h>
+#include <pxr/usd/usd/usdaFileFormat.h>
+
+#include <cstring>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+TF_DEFINE_PUBLIC_TOKENS(S3FileFormatTokens, S3_FILE_FORMAT_TOKENS);
+
+TF_REGISTRY_FUNCTION(TfType)
+{
+    SDF_DEFINE_FILE_FORMAT(S3FileFormat, SdfFileFormat);
+}
+
+namespace {
+    // Read the manifest of a resolved .s3 layer
+    bool _ReadManifest(const std::string& resolvedPath, usd_s3::Manifest& manifest)
+    {
+        const std::shared_ptr<ArAsset> asset = ArGetResolver().OpenAsset(resolvedPath);
+        if (!asset) {
+            return false;
+        }
+        const std::shared_ptr<const char> buffer = asset->GetBuffer();
+        if (!buffer) {
+            return false;
+        }
+        std::string error;
+        if (!usd_s3::parse_manifest(buffer.get(), asset->GetSize(), manifest, error)) {
+            TF_DEBUG(USD_S3_FILEFORMAT).Msg("S3FileFormat %s is not a valid manifest: %s\n",
+                resolvedPath.c_str(), error.c_str());
+            return false;
+        }
+        return true;
+    }
+}
+
+S3FileFormat::S3FileFormat()
+    : SdfFileFormat(
+        S3FileFormatTokens->Id,
+        S3FileFormatTokens->Version,
+        S3FileFormatTokens->Target,
+        S3FileFormatTokens->Id)
+{
+}
+
+S3FileFormat::~S3FileFormat()
+{
+}
+
+bool
+S3FileFormat::IsPackage() const
+{
+    return true;
+}
+
+std::string
+S3FileFormat::GetPackageRootLayerPath(
+    const std::string& resolvedPath) const
+{
+    usd_s3::Manifest manifest;
+    if (!_ReadManifest(resolvedPath, manifest)) {
+        return std::string();
+    }
+    return manifest.objects.front().path;
+}
+
+SdfAbstractDataRefPtr
+S3FileFormat::InitData(
+    const FileFormatArguments& args) const
+{
+    // layers of the package are usd layers
+    return SdfFileFormat::FindById(UsdUsdaFileFormatTokens->Id)->InitData(args);
+}
+
+bool
+S3FileFormat::CanRead(const std::string& filePath) const
+{
+    const std::shared_ptr<ArAsset> asset = ArGetResolver().OpenAsset(filePath);
+    if (!asset) {
+        return false;
+    }
+    const size_t headerLength = std::strlen(usd_s3::MANIFEST_HEADER);
+    char header[sizeof(usd_s3::MANIFEST_HEADER)];
+    return asset->Read(header, headerLength, 0) == headerLength &&
+        std::strncmp(header, usd_s3::MANIFEST_HEADER, headerLength) == 0;
+}
+
+bool
+S3FileFormat::Read(
+    SdfLayer* layer,
+    const std::string& resolvedPath,
+    bool metadataOnly) const
+{
+    const std::string rootLayerPath = GetPackageRootLayerPath(resolvedPath);
+    if (rootLayerPath.empty()) {
+        TF_RUNTIME_ERROR("Can't read the manifest of %s", resolvedPath.c_str());
+        return false;
+    }
+    const SdfFileFormatConstPtr rootLayerFormat =
+        SdfFileFormat::FindByExtension(SdfFileFormat::GetFileExtension(rootLayerPath));
+    if (!rootLayerFormat) {
+        TF_RUNTIME_ERROR("Unknown file format of %s in %s", rootLayerPath.c_str(), resolvedPath.c_str());
+        return false;
+    }
+    TF_DEBUG(USD_S3_FILEFORMAT).Msg("S3FileFormat READ %s from %s\n",
+        rootLayerPath.c_str(), resolvedPath.c_str());
+    // the package resolver downloads all objects of the manifest on this first open
+    return rootLayerFormat->Read(layer, ArJoinPackageRelativePath(resolvedPath, rootLayerPath), metadataOnly);
+}
+
+bool
+S3FileFormat::WriteToFile(
+    const SdfLayer& layer,
+    const std::string& filePath,
+    const std::string& comment,
+    const FileFormatArguments& args) const
+{
+    TF_CODING_ERROR("Writing %s layers is not supported", S3FileFormatTokens->Id.GetText());
+    return false;
+}
+
+bool
+S3FileFormat::ReadFromString(
+    SdfLayer* layer,
+    const std::string& str) const
+{
+    // a manifest only makes sense with the objects next to it, the layer content is read as usda
+    return SdfFileFormat::FindById(UsdUsdaFileFormatTokens->Id)->ReadFromString(layer, str);
+}
+
+bool
+S3FileFormat::WriteToString(
+    const SdfLayer& layer,
+    std::string* str,
+    const std::string& comment) const
+{
+    return SdfFileFormat::FindById(UsdUsdaFileFormatTokens->Id)->WriteToString(layer, str, comment);
+}
+
+bool
+S3FileFormat::WriteToStream(
+    const SdfSpecHandle& spec,
+    std::ostream& out,
+    size_t indent) const
+{
+    return SdfFileFormat::FindById(UsdUsdaFileFormatTokens->Id)->WriteToStream(spec, out, indent);
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,77 @@
+#ifndef S3_FILE_FORMAT_H
+#define S3_FILE_FORMAT_H
+
+#include <pxr/pxr.h>
+#include <pxr/base/tf/declarePtrs.h>
+#include <pxr/base/tf/staticTokens.h>
+#include <pxr/usd/sdf/fileFormat.h>
+
+#include <iosfwd>
+#include <string>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+#define S3_FILE_FORMAT_TOKENS   \
+    ((Id,      "s3"))           \
+    ((Version, "1.0"))          \
+    ((Target,  "usd"))
+
+TF_DECLARE_PUBLIC_TOKENS(S3FileFormatTokens, S3_FILE_FORMAT_TOKENS);
+
+TF_DECLARE_WEAK_AND_REF_PTRS(S3FileFormat);
+
+/// \class S3FileFormat
+///
+/// A .s3 manifest as a package layer, see manifest.h. The layer is read from
+/// the first object listed in the manifest, the other objects are read
+/// through S3objectResolver as paths in the package. Manifests are written
+/// by the tools that upload the assets, writing layers is not supported.
+///
+class S3FileFormat : public SdfFileFormat
+{
+public:
+    bool IsPackage() const override;
+
+    std::string GetPackageRootLayerPath(
+        const std::string& resolvedPath) const override;
+
+    SdfAbstractDataRefPtr InitData(
+        const FileFormatArguments& args) const override;
+
+    bool CanRead(const std::string& file) const override;
+
+    bool Read(
+        SdfLayer* layer,
+        const std::string& resolvedPath,
+        bool metadataOnly) const override;
+
+    bool WriteToFile(
+        const SdfLayer& layer,
+        const std::string& filePath,
+        const std::string& comment = std::string(),
+        const FileFormatArguments& args = FileFormatArguments()) const override;
+
+    bool ReadFromString(
+        SdfLayer* layer,
+        const std::string& str) const override;
+
+    bool WriteToString(
+        const SdfLayer& layer,
+        std::string* str,
+        const std::string& comment = std::string()) const override;
+
+    bool WriteToStream(
+        const SdfSpecHandle& spec,
+        std::ostream& out,
+        size_t indent) const override;
+
+protected:
+    SDF_FILE_FORMAT_FACTORY_ACCESS;
+
+    S3FileFormat();
+    ~S3FileFormat() override;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // S3_FILE_FORMAT_H
@@ -0,0 +1,114 @@
+#include "manifest.h"
+
+#include <cerrno>
+#include <cstdlib>
+
+namespace {
+    // Paths stay inside the directory of the manifest and can't be mistaken
+    // for a nested package path
+    bool is_valid_path(const std::string& path) {
+        if (path.empty() || path[0] == '/' || path.find_first_of("[]\\") != std::string::npos ||
+                path.find(':') != std::string::npos) {
+            return false;
+        }
+        size_t begin = 0;
+        while (begin <= path.size()) {
+            size_t end = path.find('/', begin);
+            if (end == std::string::npos) {
+                end = path.size();
+            }
+            const std::string segment = path.substr(begin, end - begin);
+            if (segment.empty() || segment == "." || segment == "..") {
+                return false;
+            }
+            begin = end + 1;
+        }
+        return true;
+    }
+
+    // Split off the next space separated field of a line
+    std::string next_field(const std::string& line, size_t& position) {
+        const size_t begin = line.find_first_not_of(' ', position);
+        if (begin == std::string::npos) {
+            position = line.size();
+            return std::string();
+        }
+        size_t end = line.find(' ', begin);
+        if (end == std::string::npos) {
+            end = line.size();
+        }
+        position = end;
+        return line.substr(begin, end - begin);
+    }
+}
+
+namespace usd_s3 {
+    const ManifestObject* Manifest::find(const std::string& path) const {
+        const auto it = index.find(path);
+        return it != index.end() ? &objects[it->second] : nullptr;
+    }
+
+    bool parse_manifest(const char* data, size_t size, Manifest& manifest, std::string& error) {
+        manifest.objects.clear();
+        manifest.index.clear();
+        const std::string content(data, size);
+        size_t begin = 0;
+        size_t line_number = 0;
+        while (begin < content.size()) {
+            size_t end = content.find('\n', begin);
+            if (end == std::string::npos) {
+                end = content.size();
+            }
+            std::string line = content.substr(begin, end - begin);
+            begin = end + 1;
+            ++line_number;
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (line_number == 1) {
+                if (line != MANIFEST_HEADER) {
+                    error = "missing '" + std::string(MANIFEST_HEADER) + "' header";
+                    return false;
+                }
+                continue;
+            }
+            if (line.find_first_not_of(' ') == std::string::npos || line[0] == '#') {
+                continue;
+            }
+
+            const std::string where = "line " + std::to_string(line_number) + ": ";
+            size_t position = 0;
+            const std::string size_field = next_field(line, position);
+            const std::string etag = next_field(line, position);
+            // the path is the rest of the line, it may contain spaces
+            const size_t path_begin = line.find_first_not_of(' ', position);
+            const std::string path = path_begin != std::string::npos ? line.substr(path_begin) : std::string();
+
+            char* size_end = nullptr;
+            errno = 0;
+            const unsigned long long object_size = std::strtoull(size_field.c_str(), &size_end, 10);
+            if (size_field.empty() || size_field[0] == '-' || *size_end != '\0' || errno == ERANGE) {
+                error = where + "invalid size '" + size_field + "'";
+                return false;
+            }
+            if (etag.empty()) {
+                error = where + "missing ETag";
+                return false;
+            }
+            if (!is_valid_path(path)) {
+                error = where + "invalid path '" + path + "'";
+                return false;
+            }
+            if (!manifest.index.insert(std::make_pair(path, manifest.objects.size())).second) {
+                error = where + "duplicate path '" + path + "'";
+                return false;
+            }
+            manifest.objects.push_back(ManifestObject{path, static_cast<size_t>(object_size), etag});
+        }
+        if (manifest.objects.empty()) {
+            error = "no objects listed";
+            return false;
+        }
+        return true;
+    }
+}
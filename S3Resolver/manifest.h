@@ -0,0 +1,45 @@
+#ifndef S3_MANIFEST_H
+#define S3_MANIFEST_H
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace usd_s3 {
+    constexpr const char MANIFEST_HEADER[] = "#s3manifest 1.0";
+
+    // An object of an asset as listed in its manifest
+    struct ManifestObject {
+        std::string path;           // relative to the manifest, e.g. geo/chair.usdc
+        size_t size;
+        std::string etag;
+    };
+
+    // A .s3 manifest lists the S3 objects that make up an asset, one per line
+    // after the header, as '<size> <etag> <path>'. Paths are relative to the
+    // directory of the manifest and the first object is the root layer, e.g.
+    //
+    //   #s3manifest 1.0
+    //   1893 "9b2cf535f27731c974343645a3985328" chair.usda
+    //   524288 "e1f3a0c5b9d2e4f6a8b0c2d4e6f8a0b2" geo/chair.usdc
+    //
+    // Blank lines and lines starting with '#' are skipped.
+    struct Manifest {
+        std::string key;            // parsed path of the manifest object
+        std::string etag;           // of the manifest object the objects were read from
+        double last_modified;       // of the manifest object, the listed objects are as old as their manifest
+        std::vector<ManifestObject> objects;
+
+        // The object listed with a path, or nullptr
+        const ManifestObject* find(const std::string& path) const;
+
+        std::unordered_map<std::string, size_t> index;   // objects by path
+    };
+
+    // Parse the content of a manifest into its objects,
+    // returns false and a description of the first problem if it isn't valid
+    bool parse_manifest(const char* data, size_t size, Manifest& manifest, std::string& error);
+}
+
+#endif // S3_MANIFEST_H
@@ -0,0 +1,45 @@
+#include "memoryAsset.h"
+
+#include <algorithm>
+#include <cstring>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+S3MemoryAsset::S3MemoryAsset(
+    const std::shared_ptr<const char>& buffer,
+    size_t size)
+    : _buffer(buffer)
+    , _size(size)
+{
+}
+
+S3MemoryAsset::~S3MemoryAsset()
+{
+}
+
+size_t S3MemoryAsset::GetSize()
+{
+    return _size;
+}
+
+std::shared_ptr<const char> S3MemoryAsset::GetBuffer()
+{
+    return _buffer;
+}
+
+size_t S3MemoryAsset::Read(void* buffer, size_t count, size_t offset)
+{
+    if (offset >= _size) {
+        return 0;
+    }
+    count = std::min(count, _size - offset);
+    std::memcpy(buffer, _buffer.get() + offset, count);
+    return count;
+}
+
+std::pair<FILE*, size_t> S3MemoryAsset::GetFileUnsafe()
+{
+    return std::make_pair(nullptr, 0);
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
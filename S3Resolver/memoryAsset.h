@@ -0,0 +1,38 @@
+#ifndef S3_MEMORY_ASSET_H
+#define S3_MEMORY_ASSET_H
+
+#include <pxr/pxr.h>
+#include <pxr/usd/ar/asset.h>
+
+#include <memory>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/// \class S3MemoryAsset
+///
+/// An ArAsset for a small S3 object kept in the memory cache. The asset
+/// shares the buffer of the cache, GetBuffer hands it out without a copy.
+///
+class S3MemoryAsset : public ArAsset
+{
+public:
+    S3MemoryAsset(
+        const std::shared_ptr<const char>& buffer,
+        size_t size);
+    ~S3MemoryAsset() override;
+
+    size_t GetSize() override;
+    std::shared_ptr<const char> GetBuffer() override;
+    size_t Read(void* buffer, size_t count, size_t offset) override;
+
+    /// There is no local file, always returns (nullptr, 0).
+    std::pair<FILE*, size_t> GetFileUnsafe() override;
+
+private:
+    const std::shared_ptr<const char> _buffer;
+    const size_t _size;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // S3_MEMORY_ASSET_H
@@ -0,0 +1,105 @@
+#include "memoryCache.h"
+#include "debugCodes.h"
+#include "metrics.h"
+
+#include <pxr/base/tf/diagnosticLite.h>
+
+#include <algorithm>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+namespace usd_s3 {
+    MemoryCache::MemoryCache()
+        : budget(0), max_object_size(0), size(0) {
+    }
+
+    void MemoryCache::configure(size_t cache_budget, size_t max_size) {
+        std::lock_guard<std::mutex> lock(mutex);
+        budget = cache_budget;
+        max_object_size = cache_budget > 0 ? std::min(max_size, cache_budget) : 0;
+        evict_over_budget();
+    }
+
+    bool MemoryCache::is_enabled() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return budget > 0;
+    }
+
+    bool MemoryCache::accepts(size_t object_size) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return budget > 0 && object_size <= max_object_size;
+    }
+
+    void MemoryCache::insert(const std::string& key, const std::string& etag, const Buffer& buffer,
+            size_t object_size) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (budget == 0) {
+            return;
+        }
+        auto it = entries.find(key);
+        if (it == entries.end()) {
+            lru.push_front(key);
+            it = entries.insert(std::make_pair(key, Entry{etag, buffer, 0, lru.begin()})).first;
+        } else {
+            lru.splice(lru.begin(), lru, it->second.position);
+            it->second.etag = etag;
+            it->second.buffer = buffer;
+        }
+        add_metric(Counter::MEMORY_BYTES, static_cast<int64_t>(object_size) - static_cast<int64_t>(it->second.size));
+        size = size - it->second.size + object_size;
+        it->second.size = object_size;
+        evict_over_budget();
+    }
+
+    bool MemoryCache::find(const std::string& key, const std::string& etag, Buffer& buffer, size_t& object_size) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(key);
+        if (it == entries.end() || (!etag.empty() && it->second.etag != etag)) {
+            return false;
+        }
+        lru.splice(lru.begin(), lru, it->second.position);
+        buffer = it->second.buffer;
+        object_size = it->second.size;
+        return true;
+    }
+
+    bool MemoryCache::contains(const std::string& key) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.find(key) != entries.end();
+    }
+
+    void MemoryCache::erase(const std::string& key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            size -= it->second.size;
+            add_metric(Counter::MEMORY_BYTES, -static_cast<int64_t>(it->second.size));
+            lru.erase(it->second.position);
+            entries.erase(it);
+        }
+    }
+
+    size_t MemoryCache::get_size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return size;
+    }
+
+    size_t MemoryCache::get_budget() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return budget;
+    }
+
+    // Drop the least recently used objects until the cache fits its budget,
+    // the most recent one stays
+    void MemoryCache::evict_over_budget() {
+        while (size > budget && lru.size() > 1) {
+            auto it = entries.find(lru.back());
+            TF_DEBUG(S3_DBG).Msg("S3: evicted %s from memory, %zu bytes\n", it->first.c_str(), it->second.size);
+            size -= it->second.size;
+            add_metric(Counter::MEMORY_BYTES, -static_cast<int64_t>(it->second.size));
+            add_metric(Counter::MEMORY_EVICTIONS);
+            entries.erase(it);
+            lru.pop_back();
+        }
+    }
+}
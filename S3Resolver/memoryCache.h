@@ -0,0 +1,58 @@
+#ifndef S3_MEMORY_CACHE_H
+#define S3_MEMORY_CACHE_H
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace usd_s3 {
+    // Keeps the content of small objects in memory within a byte budget.
+    //
+    // Buffers are shared with the assets reading them, evicting an object
+    // only drops the reference of the cache, so an open asset keeps its
+    // content. The least recently used objects are evicted when an insert
+    // exceeds the budget.
+    class MemoryCache {
+    public:
+        using Buffer = std::shared_ptr<const char>;
+
+        MemoryCache();
+
+        // A budget of 0 disables the cache
+        void configure(size_t budget, size_t max_object_size);
+
+        bool is_enabled() const;
+        // Check if an object of this size is kept in memory
+        bool accepts(size_t size) const;
+        void insert(const std::string& key, const std::string& etag, const Buffer& buffer, size_t size);
+        // Find the content of an object with the given ETag, any ETag if it is empty
+        bool find(const std::string& key, const std::string& etag, Buffer& buffer, size_t& size);
+        bool contains(const std::string& key) const;
+        void erase(const std::string& key);
+
+        size_t get_size() const;
+        size_t get_budget() const;
+
+    private:
+        struct Entry {
+            std::string etag;
+            Buffer buffer;
+            size_t size;
+            std::list<std::string>::iterator position;
+        };
+
+        void evict_over_budget();
+
+        mutable std::mutex mutex;
+        size_t budget;
+        size_t max_object_size;
+        size_t size;
+        std::list<std::string> lru;     // most recently used first
+        std::unordered_map<std::string, Entry> entries;
+    };
+}
+
+#endif // S3_MEMORY_CACHE_H
@@ -0,0 +1,321 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+    using usd_s3::COUNTER_COUNT;
+    using usd_s3::TIMER_COUNT;
+    using usd_s3::LATENCY_BUCKETS;
+
+    const char* const COUNTER_NAMES[COUNTER_COUNT] = {
+        "cache_hits",
+        "cache_misses",
+        "deduplicated_fetches",
+        "shared_fetches",
+        "adopted_fetches",
+        "negative_hits",
+        "head_requests",
+        "get_requests",
+        "list_requests",
+        "request_errors",
+        "request_retries",
+        "deadlines_exceeded",
+        "hedged_requests",
+        "hedge_wins",
+        "bytes_downloaded",
+        "in_flight_requests",
+        "revalidations_avoided",
+        "revalidations_not_modified",
+        "revalidations_changed",
+        "scanned_layers",
+        "speculative_fetches",
+        "speculative_hits",
+        "manifest_objects",
+        "progressive_loads",
+        "memory_hits",
+        "memory_misses",
+        "memory_evictions",
+        "memory_bytes",
+        "compressed_fetches",
+        "decompressed_bytes"
+    };
+
+    const char* const TIMER_NAMES[TIMER_COUNT] = {
+        "resolve_name",
+        "resolve_with_asset_info",
+        "fetch_asset",
+        "check_object",
+        "fetch_object",
+        "head_request",
+        "get_request",
+        "list_request",
+        "decompress"
+    };
+
+    // Gauges go up and down, the other counters only go up
+    bool is_gauge(size_t counter) {
+        return counter == static_cast<size_t>(usd_s3::Counter::IN_FLIGHT_REQUESTS) ||
+            counter == static_cast<size_t>(usd_s3::Counter::MEMORY_BYTES);
+    }
+
+    // The metrics recorded by one thread, only that thread writes them
+    struct ThreadMetrics {
+        std::atomic<uint64_t> counters[COUNTER_COUNT];
+        std::atomic<uint64_t> counts[TIMER_COUNT];
+        std::atomic<uint64_t> sums[TIMER_COUNT];
+        std::atomic<uint64_t> buckets[TIMER_COUNT][LATENCY_BUCKETS];
+    };
+
+    // Plain totals of the threads that exited
+    struct Registry {
+        std::mutex mutex;
+        std::vector<ThreadMetrics*> threads;
+        usd_s3::Metrics retired;
+    };
+
+    // Never destroyed, threads of other static objects may still exit during static destruction
+    Registry& get_registry() {
+        static Registry* registry = new Registry();
+        return *registry;
+    }
+
+    void add_to(std::atomic<uint64_t>& value, uint64_t delta) {
+        // single writer, no need for a read-modify-write
+        value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+    // Sum the metrics of a thread into totals
+    void accumulate(const ThreadMetrics& thread_metrics, usd_s3::Metrics& metrics) {
+        for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+            metrics.counters[i] += thread_metrics.counters[i].load(std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < TIMER_COUNT; ++i) {
+            metrics.latencies[i].count += thread_metrics.counts[i].load(std::memory_order_relaxed);
+            metrics.latencies[i].sum_us += thread_metrics.sums[i].load(std::memory_order_relaxed);
+            for (size_t j = 0; j < LATENCY_BUCKETS; ++j) {
+                metrics.latencies[i].buckets[j] += thread_metrics.buckets[i][j].load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Registers the metrics of a thread on first use and retires them when the thread exits
+    class ThreadSlot {
+    public:
+        ThreadSlot() : metrics(new ThreadMetrics()) {
+            Registry& registry = get_registry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            registry.threads.push_back(metrics);
+        }
+        ~ThreadSlot() {
+            Registry& registry = get_registry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            accumulate(*metrics, registry.retired);
+            registry.threads.erase(std::remove(registry.threads.begin(), registry.threads.end(), metrics),
+                registry.threads.end());
+            delete metrics;
+        }
+
+        ThreadMetrics* metrics;
+    };
+
+    ThreadMetrics& get_thread_metrics() {
+        thread_local ThreadSlot slot;
+        return *slot.metrics;
+    }
+
+    size_t get_bucket(uint64_t micros) {
+        size_t bucket = 0;
+        while (micros != 0 && bucket < LATENCY_BUCKETS - 1) {
+            micros >>= 1;
+            ++bucket;
+        }
+        return bucket;
+    }
+
+    // Spans are only collected while a trace runs
+    constexpr size_t MAX_TRACE_EVENTS = 1000000;
+
+    struct TraceEvent {
+        const char* name;
+        std::string label;
+        uint64_t start_us;
+        uint64_t duration_us;
+        size_t thread;
+    };
+
+    std::atomic<bool> is_tracing(false);
+    std::mutex trace_mutex;
+    usd_s3::MetricsClock::time_point trace_start;
+    std::vector<TraceEvent> trace_events;
+
+    void append_json_string(std::string& out, const std::string& value) {
+        out += '"';
+        for (const char c : value) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+                out += escaped;
+            } else {
+                out += c;
+            }
+        }
+        out += '"';
+    }
+}
+
+namespace usd_s3 {
+    void add_metric(Counter counter, int64_t value) {
+        // negative values wrap around and cancel out in the sum of all threads
+        add_to(get_thread_metrics().counters[static_cast<size_t>(counter)], static_cast<uint64_t>(value));
+    }
+
+    void record_latency(Timer timer, MetricsClock::time_point start, const char* label) {
+        const auto end = MetricsClock::now();
+        const uint64_t micros = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+        ThreadMetrics& thread_metrics = get_thread_metrics();
+        const size_t i = static_cast<size_t>(timer);
+        add_to(thread_metrics.counts[i], 1);
+        add_to(thread_metrics.sums[i], micros);
+        add_to(thread_metrics.buckets[i][get_bucket(micros)], 1);
+
+        if (is_tracing.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(trace_mutex);
+            if (is_tracing && trace_events.size() < MAX_TRACE_EVENTS && start >= trace_start) {
+                trace_events.push_back(TraceEvent{TIMER_NAMES[i], label != nullptr ? label : "",
+                    static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                        start - trace_start).count()),
+                    micros, std::hash<std::thread::id>()(std::this_thread::get_id())});
+            }
+        }
+    }
+
+    Metrics get_metrics() {
+        Registry& registry = get_registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        Metrics metrics = registry.retired;
+        for (const ThreadMetrics* thread_metrics : registry.threads) {
+            accumulate(*thread_metrics, metrics);
+        }
+        return metrics;
+    }
+
+    const char* get_metric_name(Counter counter) {
+        return COUNTER_NAMES[static_cast<size_t>(counter)];
+    }
+
+    const char* get_metric_name(Timer timer) {
+        return TIMER_NAMES[static_cast<size_t>(timer)];
+    }
+
+    // {"counters": {"cache_hits": 1, ...}, "latencies": {"resolve_name": {"count": 1, "sum_us": 20,
+    // "buckets": [0, ...]}, ...}}, bucket i counts durations below 2^i microseconds
+    std::string format_metrics_json(const Metrics& metrics) {
+        std::string out = "{\"counters\": {";
+        for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+            if (i > 0) {
+                out += ", ";
+            }
+            out += "\"" + std::string(COUNTER_NAMES[i]) + "\": ";
+            // a gauge may be read while a change is counted on one thread and not yet on another
+            out += is_gauge(i) ?
+                std::to_string(static_cast<int64_t>(metrics.counters[i])) : std::to_string(metrics.counters[i]);
+        }
+        out += "}, \"latencies\": {";
+        for (size_t i = 0; i < TIMER_COUNT; ++i) {
+            const LatencyHistogram& histogram = metrics.latencies[i];
+            if (i > 0) {
+                out += ", ";
+            }
+            out += "\"" + std::string(TIMER_NAMES[i]) + "\": {\"count\": " + std::to_string(histogram.count) +
+                ", \"sum_us\": " + std::to_string(histogram.sum_us) + ", \"buckets\": [";
+            for (size_t j = 0; j < LATENCY_BUCKETS; ++j) {
+                if (j > 0) {
+                    out += ", ";
+                }
+                out += std::to_string(histogram.buckets[j]);
+            }
+            out += "]}";
+        }
+        out += "}}";
+        return out;
+    }
+
+    // Prometheus text exposition format, latencies are histograms in seconds
+    std::string format_metrics_prometheus(const Metrics& metrics) {
+        std::string out;
+        for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+            const std::string name = std::string("usd_s3_") + COUNTER_NAMES[i];
+            if (is_gauge(i)) {
+                out += "# TYPE " + name + " gauge\n";
+                out += name + " " + std::to_string(static_cast<int64_t>(metrics.counters[i])) + "\n";
+            } else {
+                out += "# TYPE " + name + "_total counter\n";
+                out += name + "_total " + std::to_string(metrics.counters[i]) + "\n";
+            }
+        }
+        for (size_t i = 0; i < TIMER_COUNT; ++i) {
+            const LatencyHistogram& histogram = metrics.latencies[i];
+            const std::string name = std::string("usd_s3_") + TIMER_NAMES[i] + "_seconds";
+            out += "# TYPE " + name + " histogram\n";
+            uint64_t cumulative = 0;
+            char bound[32];
+            for (size_t j = 0; j + 1 < LATENCY_BUCKETS; ++j) {
+                cumulative += histogram.buckets[j];
+                snprintf(bound, sizeof(bound), "%g", static_cast<double>(uint64_t(1) << j) * 1e-6);
+                out += name + "_bucket{le=\"" + bound + "\"} " + std::to_string(cumulative) + "\n";
+            }
+            out += name + "_bucket{le=\"+Inf\"} " + std::to_string(histogram.count) + "\n";
+            snprintf(bound, sizeof(bound), "%.6f", static_cast<double>(histogram.sum_us) * 1e-6);
+            out += name + "_sum " + bound + "\n";
+            out += name + "_count " + std::to_string(histogram.count) + "\n";
+        }
+        return out;
+    }
+
+    void start_trace() {
+        std::lock_guard<std::mutex> lock(trace_mutex);
+        trace_events.clear();
+        trace_start = MetricsClock::now();
+        is_tracing = true;
+    }
+
+    std::string stop_trace() {
+        std::vector<TraceEvent> events;
+        {
+            std::lock_guard<std::mutex> lock(trace_mutex);
+            is_tracing = false;
+            events.swap(trace_events);
+        }
+        const std::string pid = std::to_string(getpid());
+        std::string out = "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+        for (size_t i = 0; i < events.size(); ++i) {
+            const TraceEvent& event = events[i];
+            if (i > 0) {
+                out += ",";
+            }
+            out += "\n{\"name\": \"" + std::string(event.name) + "\", \"cat\": \"s3\", \"ph\": \"X\", \"pid\": " + pid +
+                ", \"tid\": " + std::to_string(event.thread % 1000000) +
+                ", \"ts\": " + std::to_string(event.start_us) + ", \"dur\": " + std::to_string(event.duration_us);
+            if (!event.label.empty()) {
+                out += ", \"args\": {\"path\": ";
+                append_json_string(out, event.label);
+                out += "}";
+            }
+            out += "}";
+        }
+        out += "\n]}\n";
+        return out;
+    }
+}
@@ -0,0 +1,118 @@
+#ifndef S3_METRICS_H
+#define S3_METRICS_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace usd_s3 {
+    enum class Counter : size_t {
+        CACHE_HITS,
+        CACHE_MISSES,
+        DEDUPLICATED_FETCHES,       // fetches served by a blob another object already downloaded
+        SHARED_FETCHES,             // resolves and fetches that waited for the request of another thread
+        ADOPTED_FETCHES,            // fetches served by a download of another process sharing the cache path
+        NEGATIVE_HITS,              // resolves of objects known to be missing
+        HEAD_REQUESTS,
+        GET_REQUESTS,
+        LIST_REQUESTS,
+        REQUEST_ERRORS,
+        REQUEST_RETRIES,
+        DEADLINES_EXCEEDED,         // requests given up because their deadline passed
+        HEDGED_REQUESTS,            // duplicate GETs sent for slow first attempts
+        HEDGE_WINS,                 // duplicate GETs that finished first
+        BYTES_DOWNLOADED,
+        IN_FLIGHT_REQUESTS,         // a gauge, requests sent and not answered yet
+        REVALIDATIONS_AVOIDED,
+        REVALIDATIONS_NOT_MODIFIED,
+        REVALIDATIONS_CHANGED,
+        SCANNED_LAYERS,
+        SPECULATIVE_FETCHES,
+        SPECULATIVE_HITS,
+        MANIFEST_OBJECTS,           // objects fetched with the size and ETag of a manifest instead of a HEAD request
+        PROGRESSIVE_LOADS,          // large layers served with a placeholder while they download
+        MEMORY_HITS,                // opens served from the memory cache
+        MEMORY_MISSES,              // opens of objects that were evicted from memory after their fetch
+        MEMORY_EVICTIONS,
+        MEMORY_BYTES,               // a gauge, bytes in the memory cache
+        COMPRESSED_FETCHES,         // objects downloaded with a Content-Encoding
+        DECOMPRESSED_BYTES,         // bytes decoded from compressed objects and cached layers
+        COUNT
+    };
+
+    enum class Timer : size_t {
+        RESOLVE_NAME,
+        RESOLVE_WITH_ASSET_INFO,
+        FETCH_ASSET,
+        CHECK_OBJECT,
+        FETCH_OBJECT,
+        HEAD_REQUEST,
+        GET_REQUEST,
+        LIST_REQUEST,
+        DECOMPRESS,
+        COUNT
+    };
+
+    constexpr size_t COUNTER_COUNT = static_cast<size_t>(Counter::COUNT);
+    constexpr size_t TIMER_COUNT = static_cast<size_t>(Timer::COUNT);
+    // Bucket i of a latency histogram counts durations below 2^i microseconds,
+    // the last bucket counts the rest
+    constexpr size_t LATENCY_BUCKETS = 28;
+
+    struct LatencyHistogram {
+        uint64_t count;
+        uint64_t sum_us;
+        uint64_t buckets[LATENCY_BUCKETS];
+    };
+
+    // Totals of all threads at one point in time
+    struct Metrics {
+        uint64_t counters[COUNTER_COUNT];
+        LatencyHistogram latencies[TIMER_COUNT];
+
+        uint64_t get(Counter counter) const { return counters[static_cast<size_t>(counter)]; }
+        const LatencyHistogram& get(Timer timer) const { return latencies[static_cast<size_t>(timer)]; }
+    };
+
+    using MetricsClock = std::chrono::steady_clock;
+
+    // Counters and histograms are kept per thread and only summed when read,
+    // recording never takes a lock or contends with other threads
+    void add_metric(Counter counter, int64_t value = 1);
+    // Record the latency of an operation that started at start,
+    // and a span labeled with label while a trace is running
+    void record_latency(Timer timer, MetricsClock::time_point start, const char* label = nullptr);
+    Metrics get_metrics();
+
+    const char* get_metric_name(Counter counter);
+    const char* get_metric_name(Timer timer);
+    std::string format_metrics_json(const Metrics& metrics);
+    std::string format_metrics_prometheus(const Metrics& metrics);
+
+    // Collect a span for every latency recorded until the trace is stopped
+    void start_trace();
+    // Stop collecting spans, returns them in the Chrome trace event format
+    std::string stop_trace();
+
+    // Records the latency of a scope, the label must outlive the timer
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(Timer timer, const std::string* label = nullptr)
+            : timer(timer), label(label), start(MetricsClock::now()) {
+        }
+        ~ScopedTimer() {
+            record_latency(timer, start, label != nullptr ? label->c_str() : nullptr);
+        }
+
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    private:
+        Timer timer;
+        const std::string* label;
+        MetricsClock::time_point start;
+    };
+}
+
+#endif // S3_METRICS_H
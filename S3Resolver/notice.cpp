@@ -0,0 +1,57 @@
+#include "notice.h"
+
+#include <pxr/base/tf/registryManager.h>
+#include <pxr/base/tf/type.h>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+TF_REGISTRY_FUNCTION(TfType)
+{
+    TfType::Define<S3MetricsNotice, TfType::Bases<TfNotice> >();
+    TfType::Define<S3LayerLoadedNotice, TfType::Bases<TfNotice> >();
+}
+
+S3MetricsNotice::S3MetricsNotice(const usd_s3::Metrics& metrics)
+    : _metrics(metrics)
+{
+}
+
+S3MetricsNotice::~S3MetricsNotice()
+{
+}
+
+const usd_s3::Metrics& S3MetricsNotice::GetMetrics() const
+{
+    return _metrics;
+}
+
+S3LayerLoadedNotice::S3LayerLoadedNotice(
+    const std::string& assetPath,
+    const std::string& resolvedPath,
+    bool isLoaded)
+    : _assetPath(assetPath)
+    , _resolvedPath(resolvedPath)
+    , _isLoaded(isLoaded)
+{
+}
+
+S3LayerLoadedNotice::~S3LayerLoadedNotice()
+{
+}
+
+const std::string& S3LayerLoadedNotice::GetAssetPath() const
+{
+    return _assetPath;
+}
+
+const std::string& S3LayerLoadedNotice::GetResolvedPath() const
+{
+    return _resolvedPath;
+}
+
+bool S3LayerLoadedNotice::IsLoaded() const
+{
+    return _isLoaded;
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
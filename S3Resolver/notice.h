@@ -0,0 +1,60 @@
+#ifndef S3_NOTICE_H
+#define S3_NOTICE_H
+
+#include <pxr/pxr.h>
+#include <pxr/base/tf/notice.h>
+
+#include <string>
+
+#include "metrics.h"
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/// \class S3MetricsNotice
+///
+/// Sent when the last open resolver cache scope ends, usually at the end of
+/// a stage open, with the metrics of all s3 requests so far.
+///
+class S3MetricsNotice : public TfNotice
+{
+public:
+    explicit S3MetricsNotice(const usd_s3::Metrics& metrics);
+    ~S3MetricsNotice() override;
+
+    const usd_s3::Metrics& GetMetrics() const;
+
+private:
+    usd_s3::Metrics _metrics;
+};
+
+/// \class S3LayerLoadedNotice
+///
+/// Sent when the download of a layer that was served with a placeholder is
+/// done, see USD_S3_PROGRESSIVE_THRESHOLD. It is sent on a download thread,
+/// listeners reload the layer on the thread that owns its stage, with
+/// SdfLayer::Reload(true) as the modification time of the layer didn't change.
+///
+class S3LayerLoadedNotice : public TfNotice
+{
+public:
+    S3LayerLoadedNotice(
+        const std::string& assetPath,
+        const std::string& resolvedPath,
+        bool isLoaded);
+    ~S3LayerLoadedNotice() override;
+
+    /// The s3 path of the layer, e.g. 's3://kitchen/set.usd'
+    const std::string& GetAssetPath() const;
+    const std::string& GetResolvedPath() const;
+    /// False if the download failed, the layer would fail to reload
+    bool IsLoaded() const;
+
+private:
+    std::string _assetPath;
+    std::string _resolvedPath;
+    bool _isLoaded;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // S3_NOTICE_H
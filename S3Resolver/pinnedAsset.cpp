@@ -0,0 +1,40 @@
+#include "pinnedAsset.h"
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+S3PinnedAsset::S3PinnedAsset(
+    const std::shared_ptr<ArAsset>& asset,
+    const std::function<void()>& release)
+    : _asset(asset)
+    , _release(release)
+{
+}
+
+S3PinnedAsset::~S3PinnedAsset()
+{
+    // buffers handed out by GetBuffer may outlive the asset, they don't need the file
+    _asset.reset();
+    _release();
+}
+
+size_t S3PinnedAsset::GetSize()
+{
+    return _asset->GetSize();
+}
+
+std::shared_ptr<const char> S3PinnedAsset::GetBuffer()
+{
+    return _asset->GetBuffer();
+}
+
+size_t S3PinnedAsset::Read(void* buffer, size_t count, size_t offset)
+{
+    return _asset->Read(buffer, count, offset);
+}
+
+std::pair<FILE*, size_t> S3PinnedAsset::GetFileUnsafe()
+{
+    return _asset->GetFileUnsafe();
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
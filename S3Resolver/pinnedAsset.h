@@ -0,0 +1,38 @@
+#ifndef S3_PINNED_ASSET_H
+#define S3_PINNED_ASSET_H
+
+#include <pxr/pxr.h>
+#include <pxr/usd/ar/asset.h>
+
+#include <functional>
+#include <memory>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/// \class S3PinnedAsset
+///
+/// An ArAsset for a file in the local cache that keeps the file from being
+/// evicted while it is open. Reads are forwarded to the wrapped asset,
+/// the release function is called when the asset is destroyed.
+///
+class S3PinnedAsset : public ArAsset
+{
+public:
+    S3PinnedAsset(
+        const std::shared_ptr<ArAsset>& asset,
+        const std::function<void()>& release);
+    ~S3PinnedAsset() override;
+
+    size_t GetSize() override;
+    std::shared_ptr<const char> GetBuffer() override;
+    size_t Read(void* buffer, size_t count, size_t offset) override;
+    std::pair<FILE*, size_t> GetFileUnsafe() override;
+
+private:
+    std::shared_ptr<ArAsset> _asset;
+    std::function<void()> _release;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // S3_PINNED_ASSET_H
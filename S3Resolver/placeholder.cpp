@@ -0,0 +1,89 @@
+#include "placeholder.h"
+
+#include <pxr/base/tf/pathUtils.h>
+#include <pxr/base/tf/stringUtils.h>
+#include <pxr/usd/usd/zipFile.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+namespace {
+    std::string format_vector(double x, double y, double z) {
+        return TfStringPrintf("(%.9g, %.9g, %.9g)", x, y, z);
+    }
+
+    // The placeholder as usda text. It is written while USD holds the lock of
+    // its layer registry, so it can't be built with an SdfLayer.
+    std::string make_placeholder_layer(const usd_s3::PlaceholderInfo& info) {
+        std::string layer = "#usda 1.0\n(\n";
+        if (!info.default_prim.empty()) {
+            layer += "    defaultPrim = \"" + info.default_prim + "\"\n";
+        }
+        layer += "    doc = \"Placeholder of a layer that is still downloading\"\n)\n";
+        if (info.default_prim.empty()) {
+            return layer;
+        }
+        layer += "\ndef Xform \"" + info.default_prim + "\"\n{\n";
+        if (info.has_extent) {
+            // a unit cube scaled to the extent
+            const double* extent = info.extent;
+            layer += "    def Cube \"Placeholder\"\n    {\n"
+                "        float3[] extent = [(-0.5, -0.5, -0.5), (0.5, 0.5, 0.5)]\n"
+                "        double size = 1\n"
+                "        double3 xformOp:scale = " +
+                format_vector(extent[3] - extent[0], extent[4] - extent[1], extent[5] - extent[2]) + "\n"
+                "        double3 xformOp:translate = " +
+                format_vector((extent[0] + extent[3]) * 0.5, (extent[1] + extent[4]) * 0.5,
+                    (extent[2] + extent[5]) * 0.5) + "\n"
+                "        uniform token[] xformOpOrder = [\"xformOp:translate\", \"xformOp:scale\"]\n"
+                "    }\n";
+        }
+        layer += "}\n";
+        return layer;
+    }
+
+    bool write_file(const std::string& path, const std::string& content) {
+        std::ofstream file(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        file << content;
+        return static_cast<bool>(file);
+    }
+}
+
+namespace usd_s3 {
+    bool can_have_placeholder(const std::string& path) {
+        const std::string extension = TfGetExtension(path);
+        return extension == "usd" || extension == "usda" || extension == "usdz";
+    }
+
+    PlaceholderInfo parse_placeholder_info(const std::string& default_prim, const std::string& extent) {
+        PlaceholderInfo info = {};
+        if (TfIsValidIdentifier(default_prim)) {
+            info.default_prim = default_prim;
+        }
+        std::istringstream values(extent);
+        for (double& value : info.extent) {
+            values >> value;
+        }
+        info.has_extent = values && (values >> std::ws).eof() &&
+            info.extent[0] <= info.extent[3] && info.extent[1] <= info.extent[4] && info.extent[2] <= info.extent[5];
+        return info;
+    }
+
+    bool write_placeholder(const std::string& path, const PlaceholderInfo& info) {
+        const std::string layer = make_placeholder_layer(info);
+        if (TfGetExtension(path) != "usdz") {
+            return write_file(path, layer);
+        }
+        const std::string layer_path = path + ".usda";
+        bool success = write_file(layer_path, layer);
+        if (success) {
+            UsdZipFileWriter writer = UsdZipFileWriter::CreateNew(path);
+            success = !writer.AddFile(layer_path, "placeholder.usda").empty() && writer.Save();
+        }
+        std::remove(layer_path.c_str());
+        return success;
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef S3_PLACEHOLDER_H
+#define S3_PLACEHOLDER_H
+
+#include <string>
+
+namespace usd_s3 {
+    // User metadata of an object that describes its placeholder,
+    // set by the uploader as x-amz-meta-usd-default-prim and x-amz-meta-usd-extent
+    constexpr const char DEFAULT_PRIM_METADATA[] = "usd-default-prim";
+    constexpr const char EXTENT_METADATA[] = "usd-extent";
+
+    // What the placeholder of a layer that is still downloading shows
+    struct PlaceholderInfo {
+        std::string default_prim;   // empty if unknown
+        bool has_extent;
+        double extent[6];           // min x y z, max x y z
+    };
+
+    // Check if a layer can be served with a placeholder. Crate files can't,
+    // they are read with range requests instead, see USD_S3_LAZY_THRESHOLD.
+    bool can_have_placeholder(const std::string& path);
+
+    // Placeholder info from the values of the object metadata, e.g. 'Chair' and
+    // '-1 0 -1 1 2 1'. Invalid values are left out.
+    PlaceholderInfo parse_placeholder_info(const std::string& default_prim, const std::string& extent);
+
+    // Write a placeholder layer for the extension of path: the default prim as
+    // an Xform with a box of the extent, or an empty layer. A usdz placeholder
+    // packages a usda layer.
+    bool write_placeholder(const std::string& path, const PlaceholderInfo& info);
+}
+
+#endif // S3_PLACEHOLDER_H
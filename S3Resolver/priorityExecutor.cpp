@@ -0,0 +1,84 @@
+#include "priorityExecutor.h"
+
+namespace {
+    // priority of the tasks submitted on this thread
+    thread_local usd_s3::Priority submit_priority = usd_s3::Priority::FOREGROUND;
+}
+
+namespace usd_s3 {
+    PriorityExecutor::PriorityExecutor(size_t thread_count)
+        : is_running(true) {
+        for (size_t i = 0; i < thread_count; ++i) {
+            threads.emplace_back(&PriorityExecutor::run, this);
+        }
+    }
+
+    PriorityExecutor::~PriorityExecutor() {
+        shutdown();
+    }
+
+    void PriorityExecutor::shutdown() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            is_running = false;
+        }
+        cond.notify_all();
+        for (auto& thread : threads) {
+            if (thread.joinable()) {
+                thread.join();
+            }
+        }
+    }
+
+    bool PriorityExecutor::submit(Priority priority, std::function<void()>&& task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!is_running) {
+                return false;
+            }
+            queues[static_cast<int>(priority)].push_back(std::move(task));
+        }
+        cond.notify_one();
+        return true;
+    }
+
+    bool PriorityExecutor::SubmitToThread(std::function<void()>&& task) {
+        return submit(submit_priority, std::move(task));
+    }
+
+    void PriorityExecutor::run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            int priority = 0;
+            while (priority < PRIORITY_COUNT && queues[priority].empty()) {
+                ++priority;
+            }
+            if (priority == PRIORITY_COUNT) {
+                // the queue is drained before the threads exit
+                if (!is_running) {
+                    return;
+                }
+                cond.wait(lock);
+                continue;
+            }
+            std::function<void()> task = std::move(queues[priority].front());
+            queues[priority].pop_front();
+            lock.unlock();
+            {
+                // tasks submitted by this task inherit its priority
+                ScopedPriority scoped_priority(static_cast<Priority>(priority));
+                task();
+            }
+            lock.lock();
+        }
+    }
+
+    PriorityExecutor::ScopedPriority::ScopedPriority(Priority priority)
+        : previous(submit_priority) {
+        submit_priority = priority;
+    }
+
+    PriorityExecutor::ScopedPriority::~ScopedPriority() {
+        submit_priority = previous;
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef S3_PRIORITY_EXECUTOR_H
+#define S3_PRIORITY_EXECUTOR_H
+
+#include "asyncRequest.h"
+
+#include <aws/core/utils/threading/Executor.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace usd_s3 {
+    // A bounded thread pool that serves its queue by priority, first in
+    // first out within a priority.
+    //
+    // Tasks submitted through the Aws::Utils::Threading::Executor interface,
+    // such as the callbacks of async SDK requests, get the priority of the
+    // submitting thread: the priority of a ScopedPriority on that thread, or
+    // of the task it is running. So the requests a prefetch chains together
+    // all stay in the background.
+    class PriorityExecutor : public Aws::Utils::Threading::Executor {
+    public:
+        explicit PriorityExecutor(size_t thread_count);
+        // Shuts down, see shutdown
+        ~PriorityExecutor() override;
+
+        // Returns false once the executor is shut down, the task is not run then
+        bool submit(Priority priority, std::function<void()>&& task);
+
+        // Stop accepting tasks, run the queued ones and join the threads.
+        // Tasks that submit more tasks while the queue drains get false.
+        void shutdown();
+
+        // Sets the priority of the tasks submitted on this thread while in scope
+        class ScopedPriority {
+        public:
+            explicit ScopedPriority(Priority priority);
+            ~ScopedPriority();
+
+            ScopedPriority(const ScopedPriority&) = delete;
+            ScopedPriority& operator=(const ScopedPriority&) = delete;
+
+        private:
+            Priority previous;
+        };
+
+    protected:
+        bool SubmitToThread(std::function<void()>&& task) override;
+
+    private:
+        void run();
+
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::deque<std::function<void()>> queues[PRIORITY_COUNT];
+        std::vector<std::thread> threads;
+        bool is_running;
+    };
+}
+
+#endif // S3_PRIORITY_EXECUTOR_H
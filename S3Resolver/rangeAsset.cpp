@@ -0,0 +1,148 @@
+#include "rangeAsset.h"
+#include "s3.h"
+#include "debugCodes.h"
+
+#include <algorithm>
+#include <cstring>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+S3RangeAsset::S3RangeAsset(
+    usd_s3::S3& s3,
+    const std::string& assetPath,
+    size_t size,
+    size_t blockSize,
+    size_t cacheSize)
+    : _s3(s3)
+    , _assetPath(assetPath)
+    , _size(size)
+    , _blockSize(blockSize)
+    , _maxBlocks(std::max<size_t>(1, cacheSize / blockSize))
+    , _bytesFetched(0)
+{
+}
+
+S3RangeAsset::~S3RangeAsset()
+{
+    TF_DEBUG(S3_DBG).Msg("S3: range asset %s fetched %zu of %zu bytes\n",
+        _assetPath.c_str(), _bytesFetched, _size);
+}
+
+size_t S3RangeAsset::GetSize()
+{
+    return _size;
+}
+
+std::shared_ptr<const char> S3RangeAsset::GetBuffer()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_buffer) {
+        std::shared_ptr<char> buffer(new char[_size], std::default_delete<char[]>());
+        const size_t bytesRead = _s3.read_range(_assetPath, buffer.get(), 0, _size);
+        _bytesFetched += bytesRead;
+        if (bytesRead != _size) {
+            return nullptr;
+        }
+        _buffer = buffer;
+    }
+    return _buffer;
+}
+
+size_t S3RangeAsset::Read(void* buffer, size_t count, size_t offset)
+{
+    if (offset >= _size) {
+        return 0;
+    }
+    count = std::min(count, _size - offset);
+    if (count == 0) {
+        return 0;
+    }
+
+    const size_t first = offset / _blockSize;
+    const size_t last = (offset + count - 1) / _blockSize;
+    char* out = static_cast<char*>(buffer);
+    size_t copied = 0;
+    auto copyBlock = [&](size_t index, const std::vector<char>& block) {
+        const size_t blockStart = index * _blockSize;
+        const size_t begin = std::max(offset, blockStart) - blockStart;
+        const size_t end = std::min(offset + count - blockStart, block.size());
+        std::memcpy(out + copied, block.data() + begin, end - begin);
+        copied += end - begin;
+    };
+    for (size_t index = first; index <= last;) {
+        if (_Block block = _FindBlock(index)) {
+            copyBlock(index++, *block);
+            continue;
+        }
+        // fetch the whole run of missing blocks with one request
+        size_t runEnd = index;
+        while (runEnd < last && !_FindBlock(runEnd + 1)) {
+            ++runEnd;
+        }
+        // copy from the fetched blocks, a run longer than the block
+        // cache has evicted its first blocks again by now
+        std::vector<_Block> fetched;
+        if (!_FetchBlocks(index, runEnd, fetched)) {
+            return copied;
+        }
+        for (const _Block& block : fetched) {
+            copyBlock(index++, *block);
+        }
+    }
+    return copied;
+}
+
+std::pair<FILE*, size_t> S3RangeAsset::GetFileUnsafe()
+{
+    return std::make_pair(nullptr, 0);
+}
+
+S3RangeAsset::_Block S3RangeAsset::_FindBlock(size_t index)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    const auto it = _blocks.find(index);
+    if (it == _blocks.end()) {
+        return nullptr;
+    }
+    _lru.splice(_lru.begin(), _lru, it->second.second);
+    return it->second.first;
+}
+
+bool S3RangeAsset::_FetchBlocks(size_t first, size_t last, std::vector<_Block>& blocks)
+{
+    // fetch without holding the lock, so other readers can use cached blocks
+    const size_t offset = first * _blockSize;
+    const size_t length = std::min((last + 1) * _blockSize, _size) - offset;
+    std::vector<char> data(length);
+    const size_t bytesRead = _s3.read_range(_assetPath, data.data(), offset, length);
+    if (bytesRead != length) {
+        TF_DEBUG(S3_DBG).Msg("S3: range asset %s read %zu of %zu bytes at %zu\n",
+            _assetPath.c_str(), bytesRead, length, offset);
+        return false;
+    }
+
+    blocks.clear();
+    blocks.reserve(last - first + 1);
+    for (size_t index = first; index <= last; ++index) {
+        const size_t begin = (index - first) * _blockSize;
+        const size_t end = std::min(begin + _blockSize, length);
+        blocks.push_back(std::make_shared<const std::vector<char>>(data.begin() + begin, data.begin() + end));
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _bytesFetched += bytesRead;
+    for (size_t index = first; index <= last; ++index) {
+        if (_blocks.find(index) != _blocks.end()) {
+            continue;
+        }
+        _lru.push_front(index);
+        _blocks[index] = std::make_pair(blocks[index - first], _lru.begin());
+    }
+    while (_blocks.size() > _maxBlocks) {
+        _blocks.erase(_lru.back());
+        _lru.pop_back();
+    }
+    return true;
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,69 @@
+#ifndef S3_RANGE_ASSET_H
+#define S3_RANGE_ASSET_H
+
+#include <pxr/pxr.h>
+#include <pxr/usd/ar/asset.h>
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace usd_s3 {
+    class S3;
+}
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/// \class S3RangeAsset
+///
+/// An ArAsset for an S3 object that is never downloaded as a whole.
+/// Reads are served with range requests in multiples of the block size,
+/// fetched blocks are kept in a per asset LRU cache.
+///
+class S3RangeAsset : public ArAsset
+{
+public:
+    S3RangeAsset(
+        usd_s3::S3& s3,
+        const std::string& assetPath,
+        size_t size,
+        size_t blockSize,
+        size_t cacheSize);
+    ~S3RangeAsset() override;
+
+    size_t GetSize() override;
+
+    /// Reads the complete object, only used by readers that can't work
+    /// with ranges.
+    std::shared_ptr<const char> GetBuffer() override;
+
+    size_t Read(void* buffer, size_t count, size_t offset) override;
+
+    /// There is no local file, always returns (nullptr, 0).
+    std::pair<FILE*, size_t> GetFileUnsafe() override;
+
+private:
+    using _Block = std::shared_ptr<const std::vector<char>>;
+
+    _Block _FindBlock(size_t index);
+    bool _FetchBlocks(size_t first, size_t last, std::vector<_Block>& blocks);
+
+    usd_s3::S3& _s3;
+    const std::string _assetPath;
+    const size_t _size;
+    const size_t _blockSize;
+    const size_t _maxBlocks;
+
+    std::mutex _mutex;
+    std::list<size_t> _lru;     // most recently used block first
+    std::unordered_map<size_t, std::pair<_Block, std::list<size_t>::iterator>> _blocks;
+    std::shared_ptr<const char> _buffer;
+    size_t _bytesFetched;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // S3_RANGE_ASSET_H
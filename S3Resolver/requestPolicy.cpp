@@ -0,0 +1,75 @@
+#include "requestPolicy.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace {
+    // Upper bound of the first latency bucket
+    constexpr double MIN_LATENCY = 1e-4;
+    constexpr double BUCKETS_PER_OCTAVE = 4.0;
+
+    double get_bucket_limit(size_t bucket) {
+        return MIN_LATENCY * std::pow(2.0, static_cast<double>(bucket) / BUCKETS_PER_OCTAVE);
+    }
+
+    size_t get_bucket(double seconds) {
+        if (seconds <= MIN_LATENCY) {
+            return 0;
+        }
+        const double bucket = std::ceil(std::log2(seconds / MIN_LATENCY) * BUCKETS_PER_OCTAVE);
+        return std::min(static_cast<size_t>(bucket), usd_s3::LatencyTracker::BUCKETS - 1);
+    }
+}
+
+namespace usd_s3 {
+    double get_retry_delay(const RequestPolicy& policy, int attempt) {
+        thread_local std::mt19937 random(std::random_device{}());
+        const double backoff = std::min(policy.max_delay, policy.base_delay * std::pow(2.0, attempt - 1));
+        return std::uniform_real_distribution<double>(0.0, backoff)(random);
+    }
+
+    constexpr size_t LatencyTracker::BUCKETS;
+    constexpr uint32_t LatencyTracker::DECAY_SAMPLES;
+    constexpr uint32_t LatencyTracker::MIN_SAMPLES;
+
+    LatencyTracker::LatencyTracker()
+        : samples(0) {
+        for (auto& bucket : buckets) {
+            bucket = 0;
+        }
+    }
+
+    void LatencyTracker::record(double seconds) {
+        buckets[get_bucket(seconds)].fetch_add(1, std::memory_order_relaxed);
+        if (samples.fetch_add(1, std::memory_order_relaxed) % DECAY_SAMPLES == DECAY_SAMPLES - 1) {
+            // samples recorded while halving may be halved too, that doesn't skew the estimate much
+            for (auto& bucket : buckets) {
+                uint32_t count = bucket.load(std::memory_order_relaxed);
+                while (!bucket.compare_exchange_weak(count, count / 2, std::memory_order_relaxed)) {
+                }
+            }
+        }
+    }
+
+    double LatencyTracker::get_quantile(double quantile) const {
+        uint32_t counts[BUCKETS];
+        uint64_t total = 0;
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            counts[i] = buckets[i].load(std::memory_order_relaxed);
+            total += counts[i];
+        }
+        if (total < MIN_SAMPLES) {
+            return 0.0;
+        }
+        const double target = quantile * static_cast<double>(total);
+        uint64_t below = 0;
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            below += counts[i];
+            if (static_cast<double>(below) >= target) {
+                return get_bucket_limit(i);
+            }
+        }
+        return get_bucket_limit(BUCKETS - 1);
+    }
+}
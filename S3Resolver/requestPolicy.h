@@ -0,0 +1,46 @@
+#ifndef S3_REQUEST_POLICY_H
+#define S3_REQUEST_POLICY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace usd_s3 {
+    // Retries, deadlines and hedging of the requests to S3, see setup()
+    struct RequestPolicy {
+        int max_attempts;           // attempts per request, including the first
+        double base_delay;          // backoff before the first retry in seconds, doubled with every retry
+        double max_delay;           // upper bound of the backoff in seconds
+        double deadline;            // seconds a request may take including its retries, 0 is unlimited
+        double hedge_quantile;      // GETs without a first byte at this quantile of the latency get a duplicate, 0 is off
+    };
+
+    // Backoff before retry number attempt, starting at 1. The delay is drawn
+    // uniformly up to the exponential backoff ("full jitter"), so clients that
+    // failed at the same time don't retry at the same time.
+    double get_retry_delay(const RequestPolicy& policy, int attempt);
+
+    // An online estimate of a latency distribution.
+    // Samples are counted in a histogram with four buckets per power of two,
+    // from 100us to about 6.5s. All counts are halved every DECAY_SAMPLES
+    // samples, so the estimate follows the recent latency of the store.
+    class LatencyTracker {
+    public:
+        static constexpr size_t BUCKETS = 64;
+        static constexpr uint32_t DECAY_SAMPLES = 1024;
+        static constexpr uint32_t MIN_SAMPLES = 32;
+
+        LatencyTracker();
+
+        void record(double seconds);
+        // The latency in seconds below which the quantile of the recent
+        // samples fall, or 0 if there are too few samples for an estimate
+        double get_quantile(double quantile) const;
+
+    private:
+        std::atomic<uint32_t> buckets[BUCKETS];
+        std::atomic<uint32_t> samples;
+    };
+}
+
+#endif // S3_REQUEST_POLICY_H
@@ -1,6 +1,9 @@
+#include <pxr/base/tf/diagnostic.h>
 #include <pxr/base/tf/fileUtils.h>
+#include <pxr/base/tf/getenv.h>
 #include <pxr/base/tf/pathUtils.h>
 #include <pxr/base/tf/registryManager.h>
+#include <pxr/base/tf/stringUtils.h>
 #include <pxr/base/tf/type.h>
 
 #include <pxr/usd/ar/asset.h>
@@ -9,18 +12,25 @@
 #include <pxr/usd/ar/defaultResolver.h>
 #include <pxr/usd/ar/packageResolver.h>
 #include <pxr/usd/ar/assetInfo.h>
+#include <pxr/usd/ar/resolver.h>
 #include <pxr/usd/ar/resolverContext.h>
 
-#include <pxr/usd/ar/packageResolver.h>
 #include <pxr/usd/ar/threadLocalScopedCache.h>
 #include <pxr/usd/usd/zipFile.h>
 
 #include <tbb/concurrent_hash_map.h>
+#include <atomic>
+#include <fstream>
 #include <memory>
 
+#include <unistd.h>
+
 #include "resolver.h"
+#include "resolverContext.h"
 #include "s3.h"
 #include "debugCodes.h"
+#include "metrics.h"
+#include "notice.h"
 
 /*
  * Depending on the asset count and access frequency, it could be better to store the
@@ -30,10 +40,29 @@
 
 PXR_NAMESPACE_OPEN_SCOPE
 
-#define S3_WARN TF_WARN
-
 namespace {
     usd_s3::S3 g_s3;
+
+    // Cache scopes open on any thread, a stage open is traced until the last one ends
+    std::atomic<int> g_cacheScopes(0);
+
+    const std::string& _GetTracePath()
+    {
+        static const std::string tracePath = TfGetenv(usd_s3::TRACE_PATH_ENV_VAR);
+        return tracePath;
+    }
+
+    void _WriteTrace(const std::string& trace)
+    {
+        static std::atomic<unsigned> traceCount(0);
+        const std::string path = TfStringPrintf("%s/usd_s3_trace_%d_%u.json",
+            _GetTracePath().c_str(), getpid(), ++traceCount);
+        std::ofstream file(path.c_str());
+        file << trace;
+        if (!file) {
+            TF_WARN("[S3Resolver] failed to write trace %s", path.c_str());
+        }
+    }
 }
 
 AR_DEFINE_RESOLVER(S3Resolver, ArResolver)
@@ -73,9 +102,14 @@ std::string S3Resolver::ResolveWithAssetInfo(
 
     // S3 assets have their own cache
     if (g_s3.matches_schema(path)) {
+        usd_s3::ScopedTimer timer(usd_s3::Timer::RESOLVE_WITH_ASSET_INFO, &path);
         TF_DEBUG(USD_S3_RESOLVER).Msg("S3Resolver RESOLVE %s \n", path.c_str());
         return g_s3.resolve_name(path);
     }
+    // small s3 objects kept in memory have no file, their local path resolves to itself
+    if (g_s3.is_in_memory(path)) {
+        return path;
+    }
     // handle other assets with the default cache
     if (_CachePtr currentCache = _GetCurrentCache()) {
         _Cache::_PathToResolvedPathMap::accessor accessor;
@@ -94,28 +128,109 @@ VtValue S3Resolver::GetModificationTimestamp(
 {
     if (g_s3.matches_schema(path)) {
         TF_DEBUG(USD_S3_RESOLVER).Msg("S3Resolver TIMESTAMP %s \n", path.c_str());
+        return VtValue(g_s3.get_timestamp(path, resolvedPath));
     }
+    return ArDefaultResolver::GetModificationTimestamp(path, resolvedPath);
+}
 
-    return g_s3.matches_schema(path) ?
-           VtValue(g_s3.get_timestamp(path)) :
-           ArDefaultResolver::GetModificationTimestamp(path, resolvedPath);
+void S3Resolver::BindContext(
+    const ArResolverContext& context,
+    VtValue* bindingData)
+{
+    const S3ResolverContext* s3Context = context.Get<S3ResolverContext>();
+    if (s3Context) {
+        TF_DEBUG(USD_S3_RESOLVER).Msg("S3Resolver BIND %s\n", s3Context->GetConfig().endpoint.c_str());
+        g_s3.bind_config(s3Context->GetConfig());
+        // the default resolver rejects context types it doesn't know
+        ArDefaultResolver::BindContext(ArResolverContext(), bindingData);
+    } else {
+        ArDefaultResolver::BindContext(context, bindingData);
+    }
+}
+
+void S3Resolver::UnbindContext(
+    const ArResolverContext& context,
+    VtValue* bindingData)
+{
+    if (context.Get<S3ResolverContext>()) {
+        g_s3.unbind_config();
+        ArDefaultResolver::UnbindContext(ArResolverContext(), bindingData);
+    } else {
+        ArDefaultResolver::UnbindContext(context, bindingData);
+    }
 }
 
 bool S3Resolver::FetchToLocalResolvedPath(const std::string& path, const std::string& resolvedPath)
 {
     if (g_s3.matches_schema(path)) {
         TF_DEBUG(USD_S3_RESOLVER).Msg("S3Resolver FETCH %s to %s\n", path.c_str(), resolvedPath.c_str());
+        // large layers are served with a placeholder until their download is done
+        if (g_s3.fetch_progressive(path, resolvedPath, [path, resolvedPath](bool isLoaded) {
+                S3LayerLoadedNotice(path, resolvedPath, isLoaded).Send();
+            })) {
+            return true;
+        }
         return g_s3.fetch_asset(path, resolvedPath);
     } else {
         return ArDefaultResolver::FetchToLocalResolvedPath(path, resolvedPath);
     }
 }
 
+std::shared_ptr<ArAsset> S3Resolver::OpenAsset(const std::string& resolvedPath)
+{
+    // large s3 crate files are read with range requests, small s3 objects from memory,
+    // compressed s3 objects are decoded
+    if (std::shared_ptr<ArAsset> asset = g_s3.open_asset(resolvedPath)) {
+        TF_DEBUG(USD_S3_RESOLVER).Msg("S3Resolver OPEN %s without the local cache\n", resolvedPath.c_str());
+        return asset;
+    }
+    // cached s3 objects are not evicted while they are open
+    return g_s3.pin_asset(resolvedPath, ArDefaultResolver::OpenAsset(resolvedPath));
+}
+
+size_t S3Resolver::Prefetch(const std::vector<std::string>& paths)
+{
+    TF_DEBUG(USD_S3_RESOLVER).Msg("S3Resolver PREFETCH %zu assets\n", paths.size());
+    return g_s3.prefetch(paths);
+}
+
+std::future<std::string> S3Resolver::ResolveAsync(
+    const std::string& path,
+    usd_s3::Priority priority,
+    const std::shared_ptr<usd_s3::CancelToken>& cancel)
+{
+    if (g_s3.matches_schema(path)) {
+        TF_DEBUG(USD_S3_RESOLVER).Msg("S3Resolver RESOLVE ASYNC %s\n", path.c_str());
+        return g_s3.resolve_async(path, priority, cancel);
+    }
+    std::promise<std::string> promise;
+    promise.set_value(Resolve(path));
+    return promise.get_future();
+}
+
+std::future<bool> S3Resolver::FetchToLocalResolvedPathAsync(
+    const std::string& path,
+    const std::string& resolvedPath,
+    usd_s3::Priority priority,
+    const std::shared_ptr<usd_s3::CancelToken>& cancel)
+{
+    if (g_s3.matches_schema(path)) {
+        TF_DEBUG(USD_S3_RESOLVER).Msg("S3Resolver FETCH ASYNC %s to %s\n", path.c_str(), resolvedPath.c_str());
+        return g_s3.fetch_async(path, resolvedPath, priority, cancel);
+    }
+    std::promise<bool> promise;
+    promise.set_value(ArDefaultResolver::FetchToLocalResolvedPath(path, resolvedPath));
+    return promise.get_future();
+}
+
 void
 S3Resolver::BeginCacheScope(
     VtValue* cacheScopeData)
 {
     _cache.BeginCacheScope(cacheScopeData);
+    if (g_cacheScopes++ == 0 && !_GetTracePath().empty()) {
+        usd_s3::start_trace();
+    }
 }
 
 void
@@ -123,6 +238,20 @@ S3Resolver::EndCacheScope(
     VtValue* cacheScopeData)
 {
     _cache.EndCacheScope(cacheScopeData);
+    if (--g_cacheScopes == 0) {
+        if (!_GetTracePath().empty()) {
+            _WriteTrace(usd_s3::stop_trace());
+        }
+        S3MetricsNotice(usd_s3::get_metrics()).Send();
+    }
+}
+
+std::string S3Resolver::GetMetrics(bool prometheus)
+{
+    const usd_s3::Metrics metrics = usd_s3::get_metrics();
+    return prometheus ?
+           usd_s3::format_metrics_prometheus(metrics) :
+           usd_s3::format_metrics_json(metrics);
 }
 
 S3Resolver::_CachePtr
@@ -133,4 +262,64 @@ S3Resolver::_GetCurrentCache()
 
 // ------------------------------------------------------------
 
+AR_DEFINE_PACKAGE_RESOLVER(S3objectResolver, ArPackageResolver)
+
+S3objectResolver::S3objectResolver()
+{
+    TF_DEBUG(USD_S3_RESOLVER).Msg("Loading the S3objectResolver\n");
+}
+
+S3objectResolver::~S3objectResolver()
+{}
+
+std::string S3objectResolver::Resolve(
+    const std::string& resolvedPackagePath,
+    const std::string& packagedPath)
+{
+    const std::shared_ptr<const usd_s3::Manifest> manifest = g_s3.open_manifest(resolvedPackagePath);
+    if (!manifest) {
+        return std::string();
+    }
+    const std::string path = TfNormPath(packagedPath);
+    TF_DEBUG(USD_S3_RESOLVER).Msg("S3objectResolver RESOLVE %s in %s\n",
+        path.c_str(), resolvedPackagePath.c_str());
+    return manifest->find(path) ? path : std::string();
+}
+
+std::shared_ptr<ArAsset> S3objectResolver::OpenAsset(
+    const std::string& resolvedPackagePath,
+    const std::string& resolvedPackagedPath)
+{
+    const std::shared_ptr<const usd_s3::Manifest> manifest = g_s3.open_manifest(resolvedPackagePath);
+    if (!manifest) {
+        return nullptr;
+    }
+    const usd_s3::ManifestObject* object = manifest->find(TfNormPath(resolvedPackagedPath));
+    if (!object) {
+        return nullptr;
+    }
+    const std::string localPath = g_s3.fetch_manifest_object(*manifest, *object);
+    TF_DEBUG(USD_S3_RESOLVER).Msg("S3objectResolver OPEN %s in %s at %s\n",
+        resolvedPackagedPath.c_str(), resolvedPackagePath.c_str(), localPath.c_str());
+    if (localPath.empty()) {
+        return nullptr;
+    }
+    // served like any other s3 object, from memory, with range requests or from the local cache
+    return ArGetResolver().OpenAsset(localPath);
+}
+
+void
+S3objectResolver::BeginCacheScope(
+    VtValue* cacheScopeData)
+{
+}
+
+void
+S3objectResolver::EndCacheScope(
+    VtValue* cacheScopeData)
+{
+}
+
+// ------------------------------------------------------------
+
 PXR_NAMESPACE_CLOSE_SCOPE
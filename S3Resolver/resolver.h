@@ -5,11 +5,15 @@
 
 #include <pxr/usd/ar/assetInfo.h>
 #include <pxr/usd/ar/defaultResolver.h>
+#include <pxr/usd/ar/packageResolver.h>
 #include "pxr/usd/ar/threadLocalScopedCache.h"
 
+#include <future>
+#include <memory>
 #include <string>
+#include <vector>
 
-#include "object.h"
+#include "asyncRequest.h"
 
 PXR_NAMESPACE_OPEN_SCOPE
 
@@ -40,6 +44,44 @@ public:
         const std::string& path,
         const std::string& resolvedPath) override;
 
+    virtual std::shared_ptr<ArAsset> OpenAsset(
+        const std::string& resolvedPath) override;
+
+    /// Resolve and download the given s3 assets concurrently, so later
+    /// resolves and fetches of these assets are served from the cache.
+    /// Returns the number of assets that are available locally.
+    size_t Prefetch(const std::vector<std::string>& paths);
+
+    /// Resolve an s3 asset without blocking, on a bounded pool shared by all
+    /// async requests. Foreground requests are served before background ones,
+    /// a cancelled request that hasn't started yet resolves to an empty path.
+    /// Other assets are resolved right away.
+    std::future<std::string> ResolveAsync(
+        const std::string& path,
+        usd_s3::Priority priority = usd_s3::Priority::FOREGROUND,
+        const std::shared_ptr<usd_s3::CancelToken>& cancel = nullptr);
+
+    /// Fetch a resolved s3 asset without blocking, see ResolveAsync.
+    std::future<bool> FetchToLocalResolvedPathAsync(
+        const std::string& path,
+        const std::string& resolvedPath,
+        usd_s3::Priority priority = usd_s3::Priority::FOREGROUND,
+        const std::shared_ptr<usd_s3::CancelToken>& cancel = nullptr);
+
+    /// Bind an S3ResolverContext to override the s3 settings of this
+    /// thread, other contexts are passed on to the default resolver.
+    virtual void BindContext(
+        const ArResolverContext& context,
+        VtValue* bindingData) override;
+
+    virtual void UnbindContext(
+        const ArResolverContext& context,
+        VtValue* bindingData) override;
+
+    /// Metrics of the s3 requests and caches as JSON, or in the Prometheus
+    /// text format. S3MetricsNotice sends them when a stage is opened.
+    std::string GetMetrics(bool prometheus = false);
+
     virtual void BeginCacheScope(
         VtValue* cacheScopeData) override;
 
@@ -54,6 +96,33 @@ private:
     _CachePtr _GetCurrentCache();
 };
 
+/// \class S3objectResolver
+///
+/// Resolves the objects listed in a .s3 manifest, as paths in the manifest
+/// package, e.g. 's3://kitchen/chair.s3[geo/chair.usdc]'. All objects of a
+/// manifest are downloaded concurrently when the package is first opened.
+///
+class S3objectResolver
+    : public ArPackageResolver
+{
+public:
+    S3objectResolver();
+    ~S3objectResolver() override;
+
+    std::string Resolve(
+        const std::string& resolvedPackagePath,
+        const std::string& packagedPath) override;
+
+    std::shared_ptr<ArAsset> OpenAsset(
+        const std::string& resolvedPackagePath,
+        const std::string& resolvedPackagedPath) override;
+
+    void BeginCacheScope(
+        VtValue* cacheScopeData) override;
+
+    void EndCacheScope(
+        VtValue* cacheScopeData) override;
+};
 
 
 PXR_NAMESPACE_CLOSE_SCOPE
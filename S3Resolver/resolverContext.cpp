@@ -0,0 +1,37 @@
+#include "resolverContext.h"
+
+#include <functional>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+S3ResolverContext::S3ResolverContext()
+    : _config()
+{
+}
+
+S3ResolverContext::S3ResolverContext(const usd_s3::ClientConfig& config)
+    : _config(config)
+{
+}
+
+const usd_s3::ClientConfig& S3ResolverContext::GetConfig() const
+{
+    return _config;
+}
+
+bool S3ResolverContext::operator<(const S3ResolverContext& rhs) const
+{
+    return usd_s3::get_config_key(_config) < usd_s3::get_config_key(rhs._config);
+}
+
+bool S3ResolverContext::operator==(const S3ResolverContext& rhs) const
+{
+    return usd_s3::get_config_key(_config) == usd_s3::get_config_key(rhs._config);
+}
+
+size_t hash_value(const S3ResolverContext& context)
+{
+    return std::hash<std::string>()(usd_s3::get_config_key(context.GetConfig()));
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
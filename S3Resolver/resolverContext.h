@@ -0,0 +1,41 @@
+#ifndef S3_RESOLVER_CONTEXT_H
+#define S3_RESOLVER_CONTEXT_H
+
+#include <pxr/pxr.h>
+#include <pxr/usd/ar/resolverContext.h>
+
+#include <cstddef>
+
+#include "s3.h"
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+/// \class S3ResolverContext
+///
+/// Overrides the endpoint, region, credentials profile, cache path,
+/// timeouts and connection limit used for s3 assets while bound.
+/// Settings left empty or zero fall back to the USD_S3_* environment.
+/// Contexts with the same settings share a pooled client.
+///
+class S3ResolverContext
+{
+public:
+    S3ResolverContext();
+    explicit S3ResolverContext(const usd_s3::ClientConfig& config);
+
+    const usd_s3::ClientConfig& GetConfig() const;
+
+    bool operator<(const S3ResolverContext& rhs) const;
+    bool operator==(const S3ResolverContext& rhs) const;
+
+private:
+    usd_s3::ClientConfig _config;
+};
+
+size_t hash_value(const S3ResolverContext& context);
+
+AR_DECLARE_RESOLVER_CONTEXT(S3ResolverContext);
+
+PXR_NAMESPACE_CLOSE_SCOPE
+
+#endif // S3_RESOLVER_CONTEXT_H
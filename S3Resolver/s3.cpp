@@ -1,11 +1,31 @@
 #include "s3.h"
 #include "debugCodes.h"
+#include "rangeAsset.h"
+#include "cacheIndex.h"
+#include "cacheManager.h"
+#include "compressedAsset.h"
+#include "compression.h"
+#include "pinnedAsset.h"
+#include "memoryAsset.h"
+#include "memoryCache.h"
+#include "metrics.h"
+#include "placeholder.h"
+#include "priorityExecutor.h"
+#include "requestPolicy.h"
 
+#include <pxr/base/arch/fileSystem.h>
 #include <pxr/base/tf/diagnosticLite.h>
 #include <pxr/base/tf/fileUtils.h>
 #include <pxr/base/tf/pathUtils.h>
+#include <pxr/base/tf/stringUtils.h>
+#include <pxr/usd/ar/filesystemAsset.h>
+#include <pxr/usd/usdUtils/dependencies.h>
 
 #include <aws/core/Aws.h>
+#include <aws/core/auth/AWSAuthSigner.h>
+#include <aws/core/auth/AWSCredentialsProvider.h>
+#include <aws/core/client/DefaultRetryStrategy.h>
+#include <aws/core/utils/ratelimiter/DefaultRateLimiter.h>
 #include <aws/s3/S3Client.h>
 #include <aws/s3/model/HeadObjectRequest.h>
 #include <aws/s3/model/GetObjectRequest.h>
@@ -15,8 +35,31 @@
 #include <iostream>
 #include <fstream>
 #include <time.h>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
 
 #include <aws/core/utils/logging/LogMacros.h>
+#include <aws/core/utils/threading/Executor.h>
+
+#include <tbb/concurrent_hash_map.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
 PXR_NAMESPACE_USING_DIRECTIVE
 
@@ -75,54 +118,207 @@ namespace {
         return len - 1;
     }
 
+    // Length of the schema of an S3 url, 's3://' or 's3:'
+    size_t get_schema_length(const std::string& path) {
+        constexpr auto schema_length_short = cexpr_strlen(usd_s3::S3_PREFIX_SHORT);
+        constexpr auto schema_length = cexpr_strlen(usd_s3::S3_PREFIX);
+        return path.compare(0, schema_length, usd_s3::S3_PREFIX) == 0 ? schema_length : schema_length_short;
+    }
+
     // Parse an S3 url and strip off the prefix
     // e.g. s3://bucket/object.usd returns bucket/object.usd
     std::string parse_path(const std::string& path) {
-        constexpr auto schema_length_short = cexpr_strlen(usd_s3::S3_PREFIX_SHORT);
-        constexpr auto schema_length = cexpr_strlen(usd_s3::S3_PREFIX);
-        if (path.find(usd_s3::S3_PREFIX) == 0) {
-            return path.substr(schema_length);
-        } else {
-            return path.substr(schema_length_short);
+        return path.substr(get_schema_length(path));
+    }
+
+    // Offsets of the parts of a parsed path, found in a single pass without copying
+    // e.g. '@s3.example.com:9000/bucket/somedir/object.usd?versionId=abc123' has
+    //      the bucket 'bucket', the object 'somedir/object.usd' and the version 'abc123'
+    struct PathParts {
+        size_t bucket;          // start of the bucket, past the endpoint prefix
+        size_t bucket_end;      // the '/' after the bucket or the end of the bucket
+        size_t object_end;      // the '?' of the query or the end of the path
+        size_t version;         // start of the version ID, npos if the path isn't versioned
+        size_t version_end;
+    };
+
+    constexpr const char VERSION_ID_PARAM[] = "versionId=";
+
+    PathParts split_path(const std::string& path) {
+        const size_t size = path.size();
+        PathParts parts{0, size, size, std::string::npos, std::string::npos};
+        size_t i = 0;
+        if (size > 0 && path[0] == '@') {
+            while (i < size && path[i] != '/') {
+                ++i;
+            }
+            parts.bucket = i < size ? i + 1 : size;
+            i = parts.bucket;
+        }
+        for (; i < size && path[i] != '?'; ++i) {
+            if (path[i] == '/' && parts.bucket_end == size) {
+                parts.bucket_end = i;
+            }
+        }
+        parts.object_end = i;
+        if (parts.bucket_end > parts.object_end) {
+            parts.bucket_end = parts.object_end;
+        }
+        // the version ID is one of the query parameters
+        constexpr auto param_length = cexpr_strlen(VERSION_ID_PARAM);
+        while (i < size) {
+            const size_t param = i + 1;
+            if (path.compare(param, param_length, VERSION_ID_PARAM) == 0) {
+                parts.version = param + param_length;
+                parts.version_end = path.find('&', parts.version);
+                if (parts.version_end == std::string::npos) {
+                    parts.version_end = size;
+                }
+                break;
+            }
+            i = path.find('&', param);
+            if (i == std::string::npos) {
+                break;
+            }
         }
+        return parts;
+    }
+
+    // Get the endpoint prefix of a parsed path, objects on an endpoint other than
+    // the default one are prefixed with '@' and the endpoint
+    // e.g. 'bucket/object.usd' returns ''
+    //      '@s3.example.com:9000/bucket/object.usd' returns '@s3.example.com:9000/'
+    std::string get_endpoint_prefix(const std::string& path) {
+        return path.substr(0, split_path(path).bucket);
     }
 
     // Get the bucket from a parsed path
     // e.g. 'bucket/object.usd' returns 'bucket'
     //      'bucket/somedir/object.usd' returns 'bucket'
-    const std::string get_bucket_name(const std::string& path) {
-        return path.substr(0, path.find_first_of('/'));
+    //      '@s3.example.com:9000/bucket/object.usd' returns 'bucket'
+    std::string get_bucket_name(const std::string& path) {
+        const PathParts parts = split_path(path);
+        return path.substr(parts.bucket, parts.bucket_end - parts.bucket);
     }
 
     // Get the object from a parsed path
     // e.g. 'bucket/object.usd' returns 'object.usd'
     //      'bucket/somedir/object.usd' returns 'somedir/object.usd'
     //      'bucket/object.usd?versionId=abc123' returns object.usd
-    const std::string get_object_name(const std::string& path) {
-        const int i = path.find_first_of('/');
-        return path.substr(i, path.find_first_of('?') - i);
+    std::string get_object_name(const std::string& path) {
+        const PathParts parts = split_path(path);
+        const size_t object = std::min(parts.bucket_end + 1, parts.object_end);
+        return path.substr(object, parts.object_end - object);
     }
 
     // Check if a parsed path uses S3 versioning
     // e.g. 'bucket/object.usd' returns False
     //      'bucket/object.usd?versionId=abc123' returns True
-    const bool uses_versioning(const std::string& path) {
-        return path.find("versionId=") != std::string::npos;
+    bool uses_versioning(const std::string& path) {
+        return split_path(path).version != std::string::npos;
     }
 
     // Get the version ID of a parsed path uses S3 versioning
     // e.g. 'bucket/object.usd' returns an empty string
     //      'bucket/object.usd?versionId=abc123' returns abc123
-    const std::string get_object_versionid(const std::string& path) {
-        const int i = path.find_first_of('?');
-        if (i < 0) {
+    //      'bucket/object.usd?x=1&versionId=abc123' returns abc123
+    std::string get_object_versionid(const std::string& path) {
+        const PathParts parts = split_path(path);
+        if (parts.version == std::string::npos) {
             return std::string();
         }
-        const int j = path.find_first_of("versionId=", i);
-        if (j < 0) {
-            return std::string();
+        return path.substr(parts.version, parts.version_end - parts.version);
+    }
+
+    // Copy a part of a parsed path straight into an SDK string
+    Aws::String get_aws_string(const std::string& path, size_t begin, size_t end) {
+        return Aws::String(path.data() + begin, end - begin);
+    }
+
+    // Check if a parsed path refers to a USD layer that can have dependencies
+    bool is_layer(const std::string& path) {
+        const std::string extension = TfGetExtension(get_object_name(path));
+        return extension == "usd" || extension == "usda" || extension == "usdc" || extension == "usdz";
+    }
+
+    // Write buffer of a download stream
+    constexpr size_t DOWNLOAD_BUFFER_SIZE = 1 << 20;
+
+    // A file stream for downloads, with a larger write buffer than the default
+    class DownloadStream : public Aws::FStream {
+    public:
+        explicit DownloadStream(const std::string& path)
+            : buffer(DOWNLOAD_BUFFER_SIZE) {
+            rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+            open(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
         }
-        return path.substr(j + 10);
+
+        // Write into an existing file starting at offset, used for ranged downloads
+        DownloadStream(const std::string& path, size_t offset)
+            : buffer(DOWNLOAD_BUFFER_SIZE) {
+            rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+            open(path.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+            seekp(static_cast<std::streamoff>(offset));
+        }
+
+    private:
+        std::vector<char> buffer;
+    };
+
+    // Stream buffer that writes a response body into a caller supplied buffer
+    class RangeStreamBuf : public std::streambuf {
+    public:
+        RangeStreamBuf(char* buffer, size_t size) {
+            setp(buffer, buffer + size);
+        }
+
+        // Start over at the beginning of the buffer, for a retried request
+        void rewind() {
+            setp(pbase(), epptr());
+        }
+
+        size_t written() const {
+            return static_cast<size_t>(pptr() - pbase());
+        }
+    };
+
+    // Stream buffer that collects a response body in memory, for the memory cache
+    class MemoryStreamBuf : public std::streambuf {
+    public:
+        explicit MemoryStreamBuf(size_t expected_size)
+            : content(std::make_shared<std::vector<char>>()) {
+            content->reserve(expected_size);
+        }
+
+        // Start over with an empty body, for a retried request
+        void rewind() {
+            content->clear();
+        }
+
+        const std::shared_ptr<std::vector<char>>& get_content() const {
+            return content;
+        }
+
+    protected:
+        std::streamsize xsputn(const char* data, std::streamsize count) override {
+            content->insert(content->end(), data, data + count);
+            return count;
+        }
+
+        int_type overflow(int_type c) override {
+            if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                content->push_back(traits_type::to_char_type(c));
+            }
+            return traits_type::not_eof(c);
+        }
+
+    private:
+        std::shared_ptr<std::vector<char>> content;
+    };
+
+    // current time in seconds since the epoch
+    double now() {
+        return static_cast<double>(time(nullptr));
     }
 
     // get an environment variable
@@ -130,24 +326,87 @@ namespace {
         const auto env_var_value = getenv(env_var.c_str());
         return (env_var_value != nullptr) ? env_var_value : default_value;
     }
-
-    // TODO: random names may be required to support multiple versions of the same asset
-    // std::string generate_name(const std::string& base, const std::string& extension, char* buffer) {
-    //     std::tmpnam(buffer);
-    //     std::string ret(buffer);
-    //     const auto last_slash = ret.find_last_of('/');
-    //     if (last_slash == std::string::npos) {
-    //         return base + ret + extension;
-    //     } else {
-    //         return base + ret.substr(last_slash + 1) + extension;
-    //     }
-    // }
-
 }
 
 namespace usd_s3 {
     Aws::SDKOptions options;
-    Aws::S3::S3Client* s3_client;
+    std::string cache_dir;
+    CacheIndex cache_index;
+    CacheManager cache_manager;
+    MemoryCache memory_cache;
+
+    // An S3 client, shared by all resolver contexts with the same settings
+    struct Client {
+        std::string endpoint;       // host[:port], empty for the default endpoint
+        std::string cache_path;
+        Aws::S3::S3Client* s3;
+
+        ~Client() {
+            Aws::Delete(s3);
+        }
+    };
+
+    // Client pool, see S3::bind_config()
+    ClientConfig default_config;
+    std::shared_ptr<Client> default_client;
+    std::mutex clients_mutex;
+    std::unordered_map<std::string, std::shared_ptr<Client>> clients;   // by config key
+    // clients of the resolver contexts bound on this thread, innermost last
+    thread_local std::vector<std::shared_ptr<Client>> bound_clients;
+
+    // The client of the resolver context bound on this thread
+    const std::shared_ptr<Client>& current_client() {
+        return bound_clients.empty() ? default_client : bound_clients.back();
+    }
+
+    // Parse an S3 url in the current resolver context into path, which keeps
+    // its capacity, so parsing into a reused string doesn't allocate
+    // e.g. s3://bucket/object.usd gives bucket/object.usd for the default endpoint
+    //      and @s3.example.com:9000/bucket/object.usd for another endpoint
+    void assign_path(const std::string& asset_path, std::string& path) {
+        const size_t schema_length = std::min(get_schema_length(asset_path), asset_path.size());
+        const auto& client = current_client();
+        if (client && !client->endpoint.empty()) {
+            path.assign(1, '@');
+            path.append(client->endpoint);
+            path.append(1, '/');
+        } else {
+            path.clear();
+        }
+        path.append(asset_path, schema_length, std::string::npos);
+    }
+
+    std::string make_path(const std::string& asset_path) {
+        std::string path;
+        assign_path(asset_path, path);
+        return path;
+    }
+
+    // A parsed path in a buffer of the calling thread, for lookups on the hot
+    // path. The result is overwritten by the next call on the same thread.
+    const std::string& make_path_key(const std::string& asset_path) {
+        thread_local std::string path;
+        assign_path(asset_path, path);
+        return path;
+    }
+
+    // Find a client for the endpoint of a parsed path, preferring the bound one
+    std::shared_ptr<Client> find_client(const std::string& path) {
+        const std::string endpoint_prefix = get_endpoint_prefix(path);
+        const std::string endpoint = endpoint_prefix.empty() ? std::string() :
+            endpoint_prefix.substr(1, endpoint_prefix.size() - 2);
+        const auto client = current_client();
+        if (endpoint.empty() || (client && client->endpoint == endpoint)) {
+            return endpoint.empty() ? default_client : client;
+        }
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        for (const auto& pooled : clients) {
+            if (pooled.second->endpoint == endpoint) {
+                return pooled.second;
+            }
+        }
+        return default_client;
+    }
 
     enum CacheState {
         CACHE_MISSING,
@@ -159,240 +418,2760 @@ namespace usd_s3 {
         CacheState state;
         std::string local_path;
         double timestamp;       // date last modified
+        size_t size;            // content length reported by S3
+        size_t decoded_size;    // bytes USD reads of an object with a Content-Encoding, 0 until it was decoded
+        std::string etag;
+        double validated;       // time the local copy was last known to be current
+        double retry_after;     // missing objects aren't checked again before this time
+        unsigned failures;      // consecutive transient errors
         bool is_pinned;         // pinned (versioned) objects don't need to be checked for changes
+        bool is_fresh;          // prefetched, the next fetch doesn't need to check for changes
+        bool is_speculative;    // fetched by the dependency prefetch, not yet used by USD
+        bool is_scanned;        // dependencies of the fetched layer have been prefetched
+        bool is_in_memory;      // the content is in the memory cache instead of at the local path
+        bool is_compressed;     // stored with a Content-Encoding, the local path holds the encoded content
+        std::shared_ptr<Client> client; // sends the requests of this object
+    };
+
+    // An entry in the resolve cache.
+    // The mutex guards the cache data. While a thread talks to S3 on behalf
+    // of an entry it sets in_flight; other threads resolving or fetching the
+    // same asset wait on cond and share the result instead of sending their
+    // own request.
+    struct CacheEntry {
+        std::mutex mutex;
+        std::condition_variable cond;
+        bool in_flight = false;
+        Cache cache{CACHE_MISSING, "", INVALID_TIME, 0, 0, "", 0.0, 0.0, 0, false, false, false, false, false, false, nullptr};
     };
 
-    std::map<std::string, Cache> cached_requests;
+    // Keyed by the parsed path, e.g. bucket/object.usd?versionId=abc123
+    // tbb::concurrent_hash_map locks per bucket, so lookups of different
+    // assets don't contend with each other.
+    using CacheMap = tbb::concurrent_hash_map<std::string, std::shared_ptr<CacheEntry>>;
+    CacheMap cached_requests;
 
-    // Resolve an asset with an S3 HEAD request and store the result in the cache
-    std::string check_object(const std::string& path, Cache& cache) {
-        if (s3_client == nullptr) {
-            TF_DEBUG(S3_DBG).Msg("S3: check_object - abort due to s3_client nullptr\n");
-            return std::string();
-        }
+    // Maps local paths back to the parsed path they were resolved from,
+    // ArResolver::OpenAsset only gets the resolved (local) path
+    tbb::concurrent_hash_map<std::string, std::string> local_paths;
 
-        Aws::S3::Model::HeadObjectRequest head_request;
-        Aws::String bucket_name = get_bucket_name(path).c_str();
-        Aws::String object_name = get_object_name(path).c_str();
-        head_request.WithBucket(bucket_name).WithKey(object_name);
+    // Directory of the content-addressed blobs in the cache path
+    constexpr const char BLOB_DIR_NAME[] = ".blobs";
+
+    // The cache path of an object: USD_S3_CACHE_PATH, or the cache path of the
+    // resolver context it was resolved in. Blobs and download locks live in it.
+    const std::string& get_cache_root(const Cache& cache) {
+        return cache.client ? cache.client->cache_path : cache_dir;
+    }
 
+    // The persistent index and the cache budget cover USD_S3_CACHE_PATH only,
+    // objects in the cache path of a resolver context are left out of them
+    bool is_indexed(const Cache& cache) {
+        return get_cache_root(cache) == cache_dir;
+    }
+
+    // Local path of a parsed path in the cache,
+    // versions of an object are stored side by side
+    // e.g. 'bucket/object.usd' returns '<cache>/bucket/object.usd'
+    //      'bucket/object.usd?versionId=abc123' returns '<cache>/bucket@abc123/object.usd'
+    //      '@s3.example.com/bucket/object.usd' returns '<cache>/@s3.example.com/bucket/object.usd'
+    std::string get_local_path(const std::string& path, const Cache& cache) {
+        std::string bucket_dir = get_bucket_name(path);
         if (uses_versioning(path)) {
-            Aws::String object_versionid = get_object_versionid(path).c_str();
-            head_request.WithVersionId(object_versionid);
-            cache.is_pinned = true;
-            TF_DEBUG(S3_DBG).Msg("S3: check_object bucket: %s and object: %s and version: %s\n",
-                bucket_name.c_str(), object_name.c_str(), object_versionid.c_str());
-        } else {
-            TF_DEBUG(S3_DBG).Msg("S3: check_object bucket: %s and object: %s\n", bucket_name.c_str(), object_name.c_str());
+            bucket_dir += "@" + get_object_versionid(path);
         }
+        const std::string& cache_path = get_cache_root(cache);
+        return TfNormPath(cache_path + "/" + get_endpoint_prefix(path) + bucket_dir + "/" + get_object_name(path));
+    }
 
-        auto head_object_outcome = s3_client->HeadObject(head_request);
+    // The client sending the requests of a cache entry
+    Aws::S3::S3Client& get_client(const Cache& cache) {
+        return *(cache.client ? cache.client : default_client)->s3;
+    }
 
-        if (head_object_outcome.IsSuccess())
-        {
-            // TODO set cache_dir in S3 constructor
-            const std::string cache_dir = get_env_var(CACHE_PATH_ENV_VAR, "/tmp");
-            const std::string cache_path = TfNormPath(cache_path + "/" + bucket_name.c_str() + "/" + object_name.c_str());
-            double date_modified = head_object_outcome.GetResult().GetLastModified().SecondsWithMSPrecision();
-            TF_DEBUG(S3_DBG).Msg("S3: check_object OK %.0f\n", date_modified);
-            // store date modified in cache
-            cache.state = CACHE_NEEDS_FETCHING;
-            cache.timestamp = date_modified;
-            cache.local_path = cache_path;
-            return cache_path;
+    // Count a request that is about to be sent, returns its start time
+    MetricsClock::time_point begin_request(Counter counter) {
+        add_metric(counter);
+        add_metric(Counter::IN_FLIGHT_REQUESTS);
+        return MetricsClock::now();
+    }
+
+    // Record the latency and outcome of a request, a 304 on revalidation is no error
+    template <typename Outcome>
+    void end_request(Timer timer, MetricsClock::time_point start, const std::string& path, const Outcome& outcome) {
+        add_metric(Counter::IN_FLIGHT_REQUESTS, -1);
+        if (!outcome.IsSuccess() &&
+                outcome.GetError().GetResponseCode() != Aws::Http::HttpResponseCode::NOT_MODIFIED) {
+            add_metric(Counter::REQUEST_ERRORS);
         }
-        else
-        {
-            TF_DEBUG(S3_DBG).Msg("S3: check_object NOK\n");
-            cache.timestamp = INVALID_TIME;
-            std::cout << "HeadObjects error: " <<
-                head_object_outcome.GetError().GetExceptionName() << " " <<
-                head_object_outcome.GetError().GetMessage() << std::endl;
-            return std::string();
-        };
+        record_latency(timer, start, path.c_str());
     }
 
-    bool fetch_object(const std::string& path, Cache& cache) {
-        if (s3_client == nullptr) {
-            TF_DEBUG(S3_DBG).Msg("S3: fetch_object - abort due to s3_client nullptr\n");
+    void end_get_request(MetricsClock::time_point start, const std::string& path,
+            const Aws::S3::Model::GetObjectOutcome& outcome) {
+        end_request(Timer::GET_REQUEST, start, path, outcome);
+        if (outcome.IsSuccess()) {
+            add_metric(Counter::BYTES_DOWNLOADED, outcome.GetResult().GetContentLength());
+        }
+    }
+
+    // Request policy settings, see setup()
+    RequestPolicy request_policy{4, 0.05, 2.0, 0.0, 0.0};
+    // time to first byte of the GETs that may be hedged
+    LatencyTracker first_byte_latency;
+
+    using Deadline = MetricsClock::time_point;
+
+    // Deadline of a request sent now, a default constructed one if there is none
+    Deadline get_deadline() {
+        if (request_policy.deadline <= 0.0) {
+            return Deadline();
+        }
+        return MetricsClock::now() +
+            std::chrono::duration_cast<MetricsClock::duration>(std::chrono::duration<double>(request_policy.deadline));
+    }
+
+    // Check if a deadline has passed, or will have passed after delay seconds
+    bool is_past(Deadline deadline, double delay = 0.0) {
+        return deadline != Deadline() && MetricsClock::now() +
+            std::chrono::duration_cast<MetricsClock::duration>(std::chrono::duration<double>(delay)) >= deadline;
+    }
+
+    // Abort a request that is still running at its deadline
+    void set_deadline(Aws::AmazonWebServiceRequest& request, Deadline deadline) {
+        if (deadline != Deadline()) {
+            request.SetContinueRequestHandler([deadline](const Aws::Http::HttpRequest*) {
+                return !is_past(deadline);
+            });
+        }
+    }
+
+    // Check if a failed request is sent again, and wait for its backoff if so.
+    // The errors the SDK marks as retryable (throttling, 5xx, network errors)
+    // are retried until the attempts of the policy or the deadline run out.
+    bool retry_request(const std::string& path, const Aws::Client::AWSError<Aws::S3::S3Errors>& error,
+            int attempt, Deadline deadline) {
+        if (!error.ShouldRetry() || attempt >= request_policy.max_attempts) {
             return false;
         }
+        // only retryable errors that ran out of time count as exceeded deadlines
+        const double delay = get_retry_delay(request_policy, attempt);
+        if (!is_past(deadline, delay)) {
+            TF_DEBUG(S3_DBG).Msg("S3: retrying %s in %.3fs after attempt %d: %s\n",
+                path.c_str(), delay, attempt, error.GetMessage().c_str());
+            add_metric(Counter::REQUEST_RETRIES);
+            std::this_thread::sleep_for(std::chrono::duration<double>(delay));
+            return true;
+        }
+        TF_DEBUG(S3_DBG).Msg("S3: %s exceeded its deadline after %d attempts\n", path.c_str(), attempt);
+        add_metric(Counter::DEADLINES_EXCEEDED);
+        return false;
+    }
 
-        Aws::S3::Model::GetObjectRequest object_request;
-        Aws::String bucket_name = get_bucket_name(path).c_str();
-        Aws::String object_name = get_object_name(path).c_str();
-        object_request.WithBucket(bucket_name).WithKey(object_name);
+    Aws::S3::Model::HeadObjectOutcome head_object(Aws::S3::S3Client& client,
+            Aws::S3::Model::HeadObjectRequest& request, const std::string& path) {
+        const Deadline deadline = get_deadline();
+        set_deadline(request, deadline);
+        for (int attempt = 1;; ++attempt) {
+            const auto start = begin_request(Counter::HEAD_REQUESTS);
+            auto outcome = client.HeadObject(request);
+            end_request(Timer::HEAD_REQUEST, start, path, outcome);
+            if (outcome.IsSuccess() || !retry_request(path, outcome.GetError(), attempt, deadline)) {
+                return outcome;
+            }
+        }
+    }
 
-        if (uses_versioning(path)) {
-            Aws::String object_versionid = get_object_versionid(path).c_str();
-            object_request.WithVersionId(object_versionid);
-            TF_DEBUG(S3_DBG).Msg("S3: fetch_object bucket: %s and object: %s and version: %s\n",
-                bucket_name.c_str(), object_name.c_str(), object_versionid.c_str());
-        } else {
-            TF_DEBUG(S3_DBG).Msg("S3: fetch_object bucket: %s and object: %s\n", bucket_name.c_str(), object_name.c_str());
+    Aws::S3::Model::ListObjectsV2Outcome list_objects(Aws::S3::S3Client& client,
+            Aws::S3::Model::ListObjectsV2Request& request, const std::string& prefix) {
+        const Deadline deadline = get_deadline();
+        set_deadline(request, deadline);
+        for (int attempt = 1;; ++attempt) {
+            const auto start = begin_request(Counter::LIST_REQUESTS);
+            auto outcome = client.ListObjectsV2(request);
+            end_request(Timer::LIST_REQUEST, start, prefix, outcome);
+            if (outcome.IsSuccess() || !retry_request(prefix, outcome.GetError(), attempt, deadline)) {
+                return outcome;
+            }
         }
+    }
 
-        auto get_object_outcome = s3_client->GetObject(object_request);
+    // The response stream of a retried request is created again by its
+    // stream factory, which starts the download over
+    Aws::S3::Model::GetObjectOutcome get_object(Aws::S3::S3Client& client,
+            Aws::S3::Model::GetObjectRequest& request, const std::string& path) {
+        const Deadline deadline = get_deadline();
+        set_deadline(request, deadline);
+        for (int attempt = 1;; ++attempt) {
+            const auto start = begin_request(Counter::GET_REQUESTS);
+            auto outcome = client.GetObject(request);
+            end_get_request(start, path, outcome);
+            if (outcome.IsSuccess() || !retry_request(path, outcome.GetError(), attempt, deadline)) {
+                return outcome;
+            }
+        }
+    }
 
-        if (get_object_outcome.IsSuccess())
-        {
-            TF_DEBUG(S3_DBG).Msg("S3: fetch_object %s success\n", path.c_str());
-            // TODO: support directories in object_name
-            // prepare cache directory
-            const std::string& bucket_path = cache.local_path.substr(0, cache.local_path.find_last_of('/'));
-            if (!TfIsDir(bucket_path)) {
-                bool isSuccess = TfMakeDirs(bucket_path);
-                if (! isSuccess) {
-                    TF_DEBUG(S3_DBG).Msg("S3: fetch_object failed to create bucket directory\n");
-                    return false;
-                }
+    // Path of the blob holding the content of an object, or an empty string
+    // if the content is unknown. Blobs are addressed by ETag and size, the
+    // local paths of all objects with the same content are hard links to it.
+    std::string get_blob_path(const Cache& cache) {
+        std::string name;
+        for (const char c : cache.etag) {
+            if (isalnum(static_cast<unsigned char>(c)) || c == '-') {
+                name += c;
             }
+        }
+        if (name.empty()) {
+            return std::string();
+        }
+        return get_cache_root(cache) + "/" + BLOB_DIR_NAME + "/" + name + "-" + std::to_string(cache.size);
+    }
 
-            // TODO: set the original datemodified on the asset
-            Aws::OFStream local_file;
-            local_file.open(cache.local_path, std::ios::out | std::ios::binary);
-            local_file << get_object_outcome.GetResult().GetBody().rdbuf();
-            cache.timestamp = get_object_outcome.GetResult().GetLastModified().SecondsWithMSPrecision();
-            //TF_DEBUG(S3_DBG).Msg("S3: fetch_object version: %s\n", get_object_outcome.GetResult().GetVersionId().c_str());
-            cache.state = CACHE_FETCHED;
-            TF_DEBUG(S3_DBG).Msg("S3: fetch_object OK %.0f\n", cache.timestamp);
-            return true;
+    // Atomically replace local_path with a hard link to blob_path
+    bool link_blob(const std::string& blob_path, const std::string& local_path) {
+        static std::atomic<unsigned> link_counter(0);
+        const std::string temp_path = local_path + ".link." + std::to_string(getpid()) + "." +
+            std::to_string(++link_counter);
+        if (link(blob_path.c_str(), temp_path.c_str()) != 0) {
+            return false;
         }
-        else
-        {
-            std::cout << "GetObject error: " <<
-                get_object_outcome.GetError().GetExceptionName() << " " <<
-                get_object_outcome.GetError().GetMessage() << std::endl;
+        if (rename(temp_path.c_str(), local_path.c_str()) != 0) {
+            std::remove(temp_path.c_str());
             return false;
         }
+        return true;
     }
 
-    S3::S3() {
-        TF_DEBUG(S3_DBG).Msg("S3: client setup \n");
-        Aws::InitAPI(options);
+    // Directory of the lock files coordinating downloads between processes
+    constexpr const char LOCK_DIR_NAME[] = ".locks";
+
+    // Threads of this process holding or waiting for a lock file, see DownloadLock
+    struct LocalLock {
+        std::condition_variable cond;
+        bool is_held = false;
+        size_t users = 0;
+    };
+    std::mutex local_locks_mutex;
+    std::unordered_map<std::string, std::shared_ptr<LocalLock>> local_locks;
+
+    // Advisory lock on the download of an object, shared by all processes
+    // using the same cache path, see get_cache_root. A process that waits for the lock finds the
+    // object downloaded by the process that held it, see adopt_index_record.
+    // Every key has its own lock file, named by its hash, so a long download
+    // only holds up the downloads of the same object. The files are empty and
+    // never removed, a removed file could be locked twice.
+    // flock locks conflict between threads of a process too, so the threads of
+    // this process take turns in local_locks first and only one of them at a
+    // time locks the file. The lock may be released on another thread than
+    // the one that took it, e.g. by the callback of a prefetch.
+    class DownloadLock {
+    public:
+        DownloadLock(const std::string& path, const std::string& cache_path, bool wait)
+            : fd(-1), is_busy(false), is_local(false) {
+            // FNV-1a, the file must be the same in every process
+            uint64_t hash = 14695981039346656037ULL;
+            for (const char c : path) {
+                hash ^= static_cast<unsigned char>(c);
+                hash *= 1099511628211ULL;
+            }
+            char name[32];
+            snprintf(name, sizeof(name), "%016llx.lock", static_cast<unsigned long long>(hash));
+            lock_path = cache_path + "/" + LOCK_DIR_NAME + "/" + name;
+            if (!lock_local(wait)) {
+                is_busy = true;
+                return;
+            }
+            fd = ::open(lock_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+            if (fd < 0) {
+                // without a lock the processes download independently, as before
+                TF_DEBUG(S3_DBG).Msg("S3: failed to open download lock %s\n", lock_path.c_str());
+                return;
+            }
+            int result;
+            while ((result = flock(fd, wait ? LOCK_EX : LOCK_EX | LOCK_NB)) != 0 && errno == EINTR) {}
+            if (result != 0) {
+                ::close(fd);
+                fd = -1;
+                is_busy = true;
+                unlock_local();
+            }
+        }
+
+        ~DownloadLock() {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            unlock_local();
+        }
+
+        DownloadLock(const DownloadLock&) = delete;
+        DownloadLock& operator=(const DownloadLock&) = delete;
+
+        // another process or thread holds the lock, only when not waiting for it
+        bool busy() const {
+            return is_busy;
+        }
+
+    private:
+        bool lock_local(bool wait) {
+            std::unique_lock<std::mutex> lock(local_locks_mutex);
+            auto& local_lock = local_locks[lock_path];
+            if (!local_lock) {
+                local_lock = std::make_shared<LocalLock>();
+            }
+            const auto held = local_lock;
+            if (held->is_held && !wait) {
+                return false;
+            }
+            ++held->users;
+            held->cond.wait(lock, [&held] { return !held->is_held; });
+            held->is_held = true;
+            is_local = true;
+            return true;
+        }
 
-        Aws::Client::ClientConfiguration config;
-        // TODO: set executor to a PooledThreadExecutor to limit the number of threads
-        config.scheme = Aws::Http::SchemeMapper::FromString("http");
-        config.proxyHost = get_env_var(PROXY_HOST_ENV_VAR, "").c_str();
-        config.proxyPort = atoi(get_env_var(PROXY_PORT_ENV_VAR, "80").c_str());
-        config.connectTimeoutMs = 3000;
-        config.requestTimeoutMs = 3000;
-        s3_client = Aws::New<Aws::S3::S3Client>("s3resolver", config);
+        void unlock_local() {
+            if (!is_local) {
+                return;
+            }
+            is_local = false;
+            std::lock_guard<std::mutex> lock(local_locks_mutex);
+            const auto it = local_locks.find(lock_path);
+            it->second->is_held = false;
+            if (--it->second->users == 0) {
+                local_locks.erase(it);
+            } else {
+                it->second->cond.notify_one();
+            }
+        }
+
+        std::string lock_path;
+        int fd;
+        bool is_busy;
+        bool is_local;          // this lock holds the lock path in local_locks
+    };
+
+    // Create the directories of the blobs and the download locks in a cache path
+    void make_cache_dirs(const std::string& cache_path) {
+        for (const char* dir_name : {BLOB_DIR_NAME, LOCK_DIR_NAME}) {
+            const std::string dir = cache_path + "/" + dir_name;
+            if (!TfIsDir(dir)) {
+                TfMakeDirs(dir);
+            }
+        }
     }
 
-    S3::~S3() {
-        TF_DEBUG(S3_DBG).Msg("S3: client teardown \n");
-        Aws::Delete(s3_client);
-        Aws::ShutdownAPI(options);
+    // Check if a file in the local cache holds an object of the given size,
+    // layers compressed by the cache keep the size of their content in the gzip trailer
+    bool has_object_size(const std::string& file_path, const struct stat& file_stat, size_t size) {
+        return static_cast<size_t>(file_stat.st_size) == size || has_gzip_size(file_path, size);
     }
 
-    // Resolve an asset path such as 's3://hello/world.usd'
-    // Checks if the asset exists and returns a local path for the asset
-    std::string S3::resolve_name(const std::string& asset_path) {
-        const auto path = parse_path(asset_path);
-        TF_DEBUG(S3_DBG).Msg("S3: resolve_name %s\n", path.c_str());
-        const auto cached_result = cached_requests.find(path);
-        if (cached_result != cached_requests.end()) {
-            if (cached_result->second.state != CACHE_MISSING) {
-                TF_DEBUG(S3_DBG).Msg("S3: resolve_name - use cached result for %s\n", path.c_str());
-                return cached_result->second.local_path;
-            }
-            TF_DEBUG(S3_DBG).Msg("S3: resolve_name - refresh cached result for %s\n", path.c_str());
-            return check_object(path, cached_result->second);
-        } else {
-            Cache cache{
-                CACHE_MISSING,
-                ""
-            };
-            TF_DEBUG(S3_DBG).Msg("S3: resolve_name - no cache for %s\n", path.c_str());
-            std::string result = check_object(path, cache);
-            cached_requests.insert(std::make_pair(path, cache));
-            return result;
+    // Seed a new cache entry from the persistent index, so objects cached by an
+    // earlier process don't need a HEAD request to resolve.
+    // Pinned objects can't change and are trusted, unpinned ones are checked
+    // for updates on their first fetch.
+    void load_index_record(const std::string& path, Cache& cache) {
+        IndexRecord record;
+        if (!is_indexed(cache) || !cache_index.find(path, record)) {
+            return;
         }
+        struct stat local_stat;
+        if (stat(record.local_path.c_str(), &local_stat) != 0 ||
+                !has_object_size(record.local_path, local_stat, record.size)) {
+            TF_DEBUG(S3_DBG).Msg("S3: index record of %s doesn't match the local cache\n", path.c_str());
+            return;
+        }
+        TF_DEBUG(S3_DBG).Msg("S3: using index record of %s\n", path.c_str());
+        cache.state = CACHE_FETCHED;
+        cache.local_path = record.local_path;
+        cache.timestamp = record.last_modified;
+        cache.size = record.size;
+        cache.decoded_size = 0;
+        cache.etag = record.etag;
+        cache.validated = record.validated;
+        cache.is_pinned = record.is_pinned;
+        cache.is_fresh = record.is_pinned;
+        local_paths.insert(std::make_pair(record.local_path, path));
+    }
 
+    // Record a fetched object in the persistent index and the cache accounting
+    void store_index_record(const std::string& path, const Cache& cache) {
+        if (!is_indexed(cache)) {
+            return;
+        }
+        IndexRecord record{
+            path,
+            get_object_versionid(path),
+            cache.etag,
+            cache.local_path,
+            cache.timestamp,
+            cache.validated,
+            cache.size,
+            cache.is_pinned
+        };
+        cache_index.store(record);
+        cache_manager.insert(path, cache.local_path, cache.size);
     }
 
-    // Fetch an asset to a local path
-    // The asset should be resolved first and exist in the cache
-    bool S3::fetch_asset(const std::string& asset_path, const std::string& local_path) {
-        const auto path = parse_path(asset_path);
-        TF_DEBUG(S3_DBG).Msg("S3: fetch_asset %s\n", path.c_str());
-        if (s3_client == nullptr) {
-            TF_DEBUG(S3_DBG).Msg("S3: fetch_asset - abort due to s3_client nullptr\n");
+    // Take over an object that another process fetched or revalidated while
+    // this one waited for the download lock. Returns false if there is none.
+    bool adopt_index_record(const std::string& path, Cache& cache) {
+        IndexRecord record;
+        if (!is_indexed(cache) || !cache_index.find(path, record, true) || record.local_path != cache.local_path ||
+                record.validated <= cache.validated || record.last_modified < cache.timestamp) {
             return false;
         }
-
-        const auto cached_result = cached_requests.find(path);
-        if (cached_result == cached_requests.end()) {
-            S3_WARN("[S3Resolver] %s was not resolved before fetching!", path.c_str());
+        struct stat local_stat;
+        if (stat(record.local_path.c_str(), &local_stat) != 0 ||
+                !has_object_size(record.local_path, local_stat, record.size)) {
             return false;
         }
+        TF_DEBUG(S3_DBG).Msg("S3: fetch_object %s was fetched by another process\n", path.c_str());
+        cache.state = CACHE_FETCHED;
+        cache.timestamp = record.last_modified;
+        cache.size = record.size;
+        cache.decoded_size = 0;
+        cache.etag = record.etag;
+        cache.validated = record.validated;
+        cache_manager.insert(path, cache.local_path, cache.size);
+        add_metric(Counter::ADOPTED_FETCHES);
+        return true;
+    }
 
-        if (cached_result->second.state != CACHE_NEEDS_FETCHING && !cached_result->second.is_pinned) {
-            // ensure cache state is up to date
-            // there is no guarantee that get_timestamp was called prior to fetch
-            // note that pinned assets don't get updates
-            Cache cache{CACHE_MISSING, ""};
-            check_object(path, cache);
-            if (cache.timestamp == INVALID_TIME) {
-                cached_result->second.state = CACHE_MISSING;
-            } else if (cache.timestamp > cached_result->second.timestamp) {
-                TF_DEBUG(S3_DBG).Msg("S3: fetch_asset - local path data is out of date\n");
-                cached_result->second.state = CACHE_NEEDS_FETCHING;
-            }
+    // Find the cache entry for a parsed path, returns nullptr if the path
+    // was never resolved
+    std::shared_ptr<CacheEntry> find_cache_entry(const std::string& path) {
+        CacheMap::const_accessor accessor;
+        if (cached_requests.find(accessor, path)) {
+            return accessor->second;
         }
+        return nullptr;
+    }
 
-        if (cached_result->second.state == CACHE_MISSING) {
-            TF_DEBUG(S3_DBG).Msg("S3: fetch_asset - asset not found, no fetch\n");
-            return false;
+    // Find or create the cache entry for a parsed path.
+    // A new entry is seeded from the index before it is inserted, so the lookup
+    // doesn't hold the lock of a hash map bucket. When two threads create the
+    // same entry, the first one inserted wins.
+    std::shared_ptr<CacheEntry> get_cache_entry(const std::string& path) {
+        auto entry = find_cache_entry(path);
+        if (entry) {
+            return entry;
         }
+        entry = std::make_shared<CacheEntry>();
+        entry->cache.client = find_client(path);
+        load_index_record(path, entry->cache);
+        CacheMap::const_accessor accessor;
+        cached_requests.insert(accessor, CacheMap::value_type(path, entry));
+        return accessor->second;
+    }
 
-        if (cached_result->second.state == CACHE_NEEDS_FETCHING) {
-            if (TfPathExists(local_path)) {
-                double local_date_modified;
-                if (ArchGetModificationTime(local_path.c_str(), &local_date_modified)) {
-                    if (local_date_modified > cached_result->second.timestamp) {
-                        TF_DEBUG(S3_DBG).Msg("S3: fetch_asset - no changes, reuse local cache %.0f > %.0f\n",
-                                local_date_modified, cached_result->second.timestamp);
-                        return true;
-                    } else {
-                        TF_DEBUG(S3_DBG).Msg("S3: fetch_asset - outdated local cache %.0f < %.0f\n",
-                                local_date_modified, cached_result->second.timestamp);
-                    }
-                }
+    // Remove an object from the local cache, called by the cache manager.
+    // The object is fetched again on its next use.
+    // Note that other processes sharing the cache may still have the file open,
+    // they keep reading the unlinked file.
+    bool evict_object(const std::string& path, const std::string& local_path) {
+        auto entry = find_cache_entry(path);
+        std::unique_lock<std::mutex> lock;
+        std::string blob_path;
+        if (entry) {
+            lock = std::unique_lock<std::mutex>(entry->mutex);
+            if (entry->in_flight) {
+                return false;
             }
-            TF_DEBUG(S3_DBG).Msg("S3: fetch_asset - cache needed fetching\n");
-            cached_result->second.state = CACHE_MISSING; // we'll set this up if fetching is successful
-            bool success = fetch_object(path, cached_result->second);
-            return success;
+            if (entry->cache.state == CACHE_FETCHED && entry->cache.local_path == local_path) {
+                entry->cache.state = CACHE_NEEDS_FETCHING;
+                entry->cache.is_fresh = false;
+            }
+            blob_path = get_blob_path(entry->cache);
         } else {
-            TF_DEBUG(S3_DBG).Msg("S3: fetch_asset - cache does not need fetch\n");
+            IndexRecord record;
+            if (cache_index.find(path, record)) {
+                Cache cache{CACHE_FETCHED, record.local_path, record.last_modified, record.size, 0, record.etag,
+                    record.validated, 0.0, 0, record.is_pinned, false, false, false, false, false, nullptr};
+                blob_path = get_blob_path(cache);
+            }
         }
+        struct stat local_stat, blob_stat;
+        const bool is_last_link = !blob_path.empty() &&
+            stat(local_path.c_str(), &local_stat) == 0 && local_stat.st_nlink == 2 &&
+            stat(blob_path.c_str(), &blob_stat) == 0 && blob_stat.st_ino == local_stat.st_ino &&
+            blob_stat.st_dev == local_stat.st_dev;
+        if (std::remove(local_path.c_str()) != 0 && errno != ENOENT) {
+            TF_DEBUG(S3_DBG).Msg("S3: failed to evict %s\n", local_path.c_str());
+            return false;
+        }
+        if (is_last_link) {
+            // no other object shares the content
+            std::remove(blob_path.c_str());
+        }
+        cache_index.remove(path);
         return true;
     }
 
-    // returns true if the path matches the S3 schema
-    bool S3::matches_schema(const std::string& path) {
-        constexpr auto schema_length_short = cexpr_strlen(usd_s3::S3_PREFIX_SHORT);
-        return path.compare(0, schema_length_short, usd_s3::S3_PREFIX_SHORT) == 0;
+    // Check if a previously downloaded file is at least as recent as the remote asset
+    // Downloads carry the date modified of the remote asset (second precision).
+    bool is_local_current(const std::string& local_path, double timestamp, double& local_date_modified) {
+        return TfPathExists(local_path) &&
+            ArchGetModificationTime(local_path.c_str(), &local_date_modified) &&
+            local_date_modified >= std::floor(timestamp);
     }
 
-    double S3::get_timestamp(const std::string& asset_path) {
-        const auto path = parse_path(asset_path);
-        if (s3_client == nullptr) {
-            return 1.0;
+    // Wait until no other thread has a request in flight for this entry.
+    // Returns true if we had to wait, the entry then holds a fresh result.
+    bool wait_in_flight(CacheEntry& entry, std::unique_lock<std::mutex>& lock) {
+        if (!entry.in_flight) {
+            return false;
+        }
+        add_metric(Counter::SHARED_FETCHES);
+        entry.cond.wait(lock, [&entry] { return !entry.in_flight; });
+        return true;
+    }
+
+    // Publish the result of an in flight request and wake up the waiters
+    void finish_in_flight(CacheEntry& entry, std::unique_lock<std::mutex>& lock, const Cache& cache) {
+        if (!lock.owns_lock()) {
+            lock.lock();
         }
+        entry.cache = cache;
+        entry.in_flight = false;
+        entry.cond.notify_all();
+    }
 
-        const auto cached_result = cached_requests.find(path);
-        if (cached_result == cached_requests.end() ||
-                cached_result->second.state == CACHE_MISSING) {
-            S3_WARN("[S3Resolver] %s is missing when querying timestamps!",
-                    path.c_str());
-            return 1.0;
+    // Build the HEAD request for a parsed path
+    Aws::S3::Model::HeadObjectRequest make_head_request(const std::string& path, Cache& cache) {
+        const PathParts parts = split_path(path);
+        const size_t object = std::min(parts.bucket_end + 1, parts.object_end);
+        Aws::S3::Model::HeadObjectRequest head_request;
+        head_request.WithBucket(get_aws_string(path, parts.bucket, parts.bucket_end))
+            .WithKey(get_aws_string(path, object, parts.object_end));
+
+        if (parts.version != std::string::npos) {
+            head_request.WithVersionId(get_aws_string(path, parts.version, parts.version_end));
+            cache.is_pinned = true;
+            TF_DEBUG(S3_DBG).Msg("S3: check_object bucket: %s and object: %s and version: %s\n",
+                head_request.GetBucket().c_str(), head_request.GetKey().c_str(), head_request.GetVersionId().c_str());
         } else {
-            return cached_result->second.timestamp;
+            TF_DEBUG(S3_DBG).Msg("S3: check_object bucket: %s and object: %s\n",
+                head_request.GetBucket().c_str(), head_request.GetKey().c_str());
+        }
+        return head_request;
+    }
+
+    // Negative cache settings, see setup()
+    double negative_ttl = 0.0;
+    // Backoff of transient errors, doubled with every consecutive error
+    constexpr double MIN_RETRY_DELAY = 1.0;
+    constexpr double MAX_RETRY_DELAY = 60.0;
+
+    // Check if a missing object is known to be missing, so it doesn't need a request
+    bool is_known_missing(const Cache& cache) {
+        return cache.state == CACHE_MISSING && now() < cache.retry_after;
+    }
+
+    // Check if a failed request means the object doesn't exist, rather than a transient error
+    bool is_missing_error(const Aws::Client::AWSError<Aws::S3::S3Errors>& error) {
+        const auto response_code = error.GetResponseCode();
+        // S3 answers 403 for missing objects without the ListBucket permission
+        return !error.ShouldRetry() && (response_code == Aws::Http::HttpResponseCode::NOT_FOUND ||
+            response_code == Aws::Http::HttpResponseCode::FORBIDDEN);
+    }
+
+    // Remember a failed HEAD request, an object that doesn't exist is not
+    // checked again within the negative TTL, transient errors back off exponentially
+    void store_head_error(const std::string& path,
+            const Aws::Client::AWSError<Aws::S3::S3Errors>& error, Cache& cache) {
+        cache.timestamp = INVALID_TIME;
+        if (is_missing_error(error)) {
+            TF_DEBUG(S3_DBG).Msg("S3: check_object %s not found, not checked again for %.0fs\n",
+                path.c_str(), negative_ttl);
+            cache.state = CACHE_MISSING;
+            cache.failures = 0;
+            cache.retry_after = now() + negative_ttl;
+            return;
+        }
+        const double delay = std::min(MAX_RETRY_DELAY, MIN_RETRY_DELAY * std::pow(2.0, cache.failures));
+        ++cache.failures;
+        cache.retry_after = now() + delay;
+        S3_WARN("[S3Resolver] HEAD %s failed: %s %s, not checked again for %.0fs", path.c_str(),
+            error.GetExceptionName().c_str(), error.GetMessage().c_str(), delay);
+    }
+
+    // Remember a GET that failed after the retries of the request policy, an object
+    // that no longer exists is missing, transient errors leave the cache entry as it was
+    void store_get_error(const std::string& path,
+            const Aws::Client::AWSError<Aws::S3::S3Errors>& error, Cache& cache) {
+        if (is_missing_error(error)) {
+            store_head_error(path, error, cache);
+            return;
+        }
+        S3_WARN("[S3Resolver] GET %s failed: %s %s", path.c_str(),
+            error.GetExceptionName().c_str(), error.GetMessage().c_str());
+    }
+
+    // Store what S3 reported about an existing object in the cache
+    // Returns the local path of the asset
+    std::string store_object_info(const std::string& path, double date_modified, size_t size,
+            const std::string& etag, Cache& cache) {
+        const std::string cache_path = get_local_path(path, cache);
+        // store date modified in cache
+        cache.state = CACHE_NEEDS_FETCHING;
+        cache.timestamp = date_modified;
+        cache.size = size;
+        if (etag != cache.etag) {
+            cache.decoded_size = 0;
+        }
+        cache.etag = etag;
+        cache.local_path = cache_path;
+        cache.retry_after = 0.0;
+        cache.failures = 0;
+        local_paths.insert(std::make_pair(cache_path, path));
+        return cache_path;
+    }
+
+    // Layers at least this large are loaded progressively, 0 is off, see S3::fetch_progressive
+    size_t progressive_threshold = 0;
+    // Placeholder paths by parsed path, while their layer downloads
+    tbb::concurrent_hash_map<std::string, std::string> placeholders;
+    // What the placeholders of large layers show, by parsed path
+    tbb::concurrent_hash_map<std::string, PlaceholderInfo> placeholder_infos;
+
+    // Keep what the uploader of a large layer set for its placeholder
+    void store_placeholder_info(const std::string& path, size_t size,
+            const Aws::Map<Aws::String, Aws::String>& metadata) {
+        if (progressive_threshold == 0 || size < progressive_threshold || !can_have_placeholder(get_object_name(path))) {
+            return;
+        }
+        const auto default_prim = metadata.find(DEFAULT_PRIM_METADATA);
+        const auto extent = metadata.find(EXTENT_METADATA);
+        if (default_prim == metadata.end() && extent == metadata.end()) {
+            return;
+        }
+        tbb::concurrent_hash_map<std::string, PlaceholderInfo>::accessor accessor;
+        placeholder_infos.insert(accessor, path);
+        accessor->second = parse_placeholder_info(
+            default_prim != metadata.end() ? default_prim->second.c_str() : "",
+            extent != metadata.end() ? extent->second.c_str() : "");
+    }
+
+    // Store the result of a HEAD request in the cache
+    // Returns the local path of the asset, or an empty string if it is missing
+    std::string store_head_outcome(const std::string& path,
+            const Aws::S3::Model::HeadObjectOutcome& head_object_outcome, Cache& cache) {
+        if (head_object_outcome.IsSuccess())
+        {
+            double date_modified = head_object_outcome.GetResult().GetLastModified().SecondsWithMSPrecision();
+            TF_DEBUG(S3_DBG).Msg("S3: check_object OK %.0f\n", date_modified);
+            store_placeholder_info(path, static_cast<size_t>(head_object_outcome.GetResult().GetContentLength()),
+                head_object_outcome.GetResult().GetMetadata());
+            cache.is_compressed = parse_content_encoding(
+                head_object_outcome.GetResult().GetContentEncoding().c_str()) != Encoding::IDENTITY;
+            return store_object_info(path, date_modified,
+                static_cast<size_t>(head_object_outcome.GetResult().GetContentLength()),
+                head_object_outcome.GetResult().GetETag().c_str(), cache);
+        }
+        else
+        {
+            TF_DEBUG(S3_DBG).Msg("S3: check_object NOK\n");
+            store_head_error(path, head_object_outcome.GetError(), cache);
+            return std::string();
+        };
+    }
+
+    // Resolve an asset with an S3 HEAD request and store the result in the cache
+    std::string check_object(const std::string& path, Cache& cache) {
+        if (default_client == nullptr) {
+            TF_DEBUG(S3_DBG).Msg("S3: check_object - abort due to missing client\n");
+            return std::string();
+        }
+
+        ScopedTimer timer(Timer::CHECK_OBJECT, &path);
+        auto head_request = make_head_request(path, cache);
+        return store_head_outcome(path, head_object(get_client(cache), head_request, path), cache);
+    }
+
+    // An object found by listing a prefix
+    struct ListedObject {
+        double timestamp;
+        size_t size;
+        std::string etag;
+    };
+
+    // The objects under a prefix that is resolved with ListObjectsV2
+    // instead of a HEAD request per object, see setup()
+    struct PrefixListing {
+        std::string prefix;     // parsed path prefix, e.g. bucket/library/
+        std::mutex mutex;
+        std::condition_variable cond;
+        bool in_flight = false;
+        bool is_listed = false;
+        double listed_at = 0.0;
+        double retry_after = 0.0;
+        std::unordered_map<std::string, ListedObject> objects;
+    };
+
+    std::vector<std::unique_ptr<PrefixListing>> prefix_listings;   // longest prefix first
+
+    // List all objects under a parsed path prefix, one request per 1000 objects
+    bool list_prefix(Aws::S3::S3Client& client, const std::string& prefix,
+            std::unordered_map<std::string, ListedObject>& objects) {
+        const std::string bucket = get_bucket_name(prefix);
+        const std::string object_prefix = prefix.size() > bucket.size() ? prefix.substr(bucket.size() + 1) : std::string();
+        Aws::S3::Model::ListObjectsV2Request list_request;
+        list_request.WithBucket(bucket.c_str()).WithPrefix(object_prefix.c_str());
+        for (;;) {
+            auto list_outcome = list_objects(client, list_request, prefix);
+            if (!list_outcome.IsSuccess()) {
+                S3_WARN("[S3Resolver] listing %s failed: %s %s", prefix.c_str(),
+                    list_outcome.GetError().GetExceptionName().c_str(), list_outcome.GetError().GetMessage().c_str());
+                return false;
+            }
+            const auto& result = list_outcome.GetResult();
+            for (const auto& object : result.GetContents()) {
+                objects[bucket + "/" + object.GetKey().c_str()] = ListedObject{
+                    object.GetLastModified().SecondsWithMSPrecision(),
+                    static_cast<size_t>(object.GetSize()),
+                    object.GetETag().c_str()};
+            }
+            if (!result.GetIsTruncated()) {
+                break;
+            }
+            list_request.WithContinuationToken(result.GetNextContinuationToken());
+        }
+        TF_DEBUG(S3_DBG).Msg("S3: listed %zu objects under %s\n", objects.size(), prefix.c_str());
+        return true;
+    }
+
+    double freshness_ttl(const std::string& path);
+
+    // Resolve an asset from the listing of its prefix, the first resolve under
+    // a prefix lists it. Objects that are absent from a recent listing are missing.
+    // The listing is trusted as long as the objects under the prefix are, see
+    // freshness_ttl, and at least for the negative TTL, so it isn't listed again
+    // for every resolve. Objects that were seen before are checked on their own.
+    // Returns false if the asset is not under a listed prefix.
+    bool resolve_listed(const std::string& path, Cache& cache) {
+        if (default_client == nullptr || uses_versioning(path) || !cache.etag.empty()) {
+            return false;
+        }
+        PrefixListing* listing = nullptr;
+        for (const auto& candidate : prefix_listings) {
+            if (path.compare(0, candidate->prefix.size(), candidate->prefix) == 0) {
+                listing = candidate.get();
+                break;
+            }
+        }
+        if (listing == nullptr) {
+            return false;
+        }
+
+        std::unique_lock<std::mutex> lock(listing->mutex);
+        while (listing->in_flight) {
+            listing->cond.wait(lock);
+        }
+        if (listing->is_listed &&
+                now() >= listing->listed_at + std::max(freshness_ttl(listing->prefix), negative_ttl)) {
+            TF_DEBUG(S3_DBG).Msg("S3: listing of %s expired\n", listing->prefix.c_str());
+            listing->is_listed = false;
+        }
+        if (!listing->is_listed) {
+            if (now() < listing->retry_after) {
+                return false;
+            }
+            // list without holding the lock, other resolves under the prefix wait for it
+            listing->in_flight = true;
+            lock.unlock();
+            std::unordered_map<std::string, ListedObject> objects;
+            const bool success = list_prefix(get_client(cache), listing->prefix, objects);
+            lock.lock();
+            listing->in_flight = false;
+            if (success) {
+                listing->objects.swap(objects);
+                listing->is_listed = true;
+                listing->listed_at = now();
+            } else {
+                // resolve with HEAD requests for a while
+                listing->retry_after = now() + MAX_RETRY_DELAY;
+            }
+            listing->cond.notify_all();
+            if (!success) {
+                return false;
+            }
+        }
+
+        const auto it = listing->objects.find(path);
+        if (it == listing->objects.end()) {
+            if (now() >= listing->listed_at + negative_ttl) {
+                // the object may have been added since, check it
+                return false;
+            }
+            TF_DEBUG(S3_DBG).Msg("S3: resolve_name - %s is not in the listing of %s\n",
+                path.c_str(), listing->prefix.c_str());
+            cache.state = CACHE_MISSING;
+            cache.timestamp = INVALID_TIME;
+            cache.retry_after = listing->listed_at + negative_ttl;
+            return true;
+        }
+        TF_DEBUG(S3_DBG).Msg("S3: resolve_name - %s found in the listing of %s\n",
+            path.c_str(), listing->prefix.c_str());
+        store_object_info(path, it->second.timestamp, it->second.size, it->second.etag, cache);
+        return true;
+    }
+
+    // Build the GET request for a parsed path
+    Aws::S3::Model::GetObjectRequest make_get_request(const std::string& path) {
+        const PathParts parts = split_path(path);
+        const size_t object = std::min(parts.bucket_end + 1, parts.object_end);
+        Aws::S3::Model::GetObjectRequest object_request;
+        object_request.WithBucket(get_aws_string(path, parts.bucket, parts.bucket_end))
+            .WithKey(get_aws_string(path, object, parts.object_end));
+
+        if (parts.version != std::string::npos) {
+            object_request.WithVersionId(get_aws_string(path, parts.version, parts.version_end));
+            TF_DEBUG(S3_DBG).Msg("S3: fetch_object bucket: %s and object: %s and version: %s\n",
+                object_request.GetBucket().c_str(), object_request.GetKey().c_str(),
+                object_request.GetVersionId().c_str());
+        } else {
+            TF_DEBUG(S3_DBG).Msg("S3: fetch_object bucket: %s and object: %s\n",
+                object_request.GetBucket().c_str(), object_request.GetKey().c_str());
+        }
+        return object_request;
+    }
+
+    // Create the directory of the local path of a cache entry
+    bool make_local_dir(const Cache& cache) {
+        const std::string bucket_path = cache.local_path.substr(0, cache.local_path.find_last_of('/'));
+        if (!TfIsDir(bucket_path)) {
+            // another thread may create the directory at the same time
+            bool isSuccess = TfMakeDirs(bucket_path) || TfIsDir(bucket_path);
+            if (! isSuccess) {
+                TF_DEBUG(S3_DBG).Msg("S3: fetch_object failed to create bucket directory\n");
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Prepare the cache directory for a download and return a unique temporary
+    // path next to the local path, or an empty string on failure.
+    // Objects are downloaded to the temporary path and renamed into place when
+    // complete, so readers never see a partially written file.
+    std::string prepare_download(const Cache& cache) {
+        if (!make_local_dir(cache)) {
+            return std::string();
+        }
+        static std::atomic<unsigned> download_counter(0);
+        return cache.local_path + ".part." + std::to_string(getpid()) + "." + std::to_string(++download_counter);
+    }
+
+    // Let the SDK write the response body straight to the temporary file
+    // instead of buffering it in memory
+    void stream_to_file(Aws::S3::Model::GetObjectRequest& object_request, const std::string& temp_path) {
+        object_request.SetResponseStreamFactory([temp_path]() {
+            return Aws::New<DownloadStream>("s3resolver", temp_path);
+        });
+    }
+
+    // Cache compression setting, see setup()
+    bool cache_compression = false;
+
+    // Check if a downloaded file is a text layer, crate files and packages are compressed already
+    bool is_text_layer(const std::string& temp_path, const std::string& local_path) {
+        const std::string extension = TfGetExtension(local_path);
+        if (extension == "usda") {
+            return true;
+        }
+        if (extension != "usd") {
+            return false;
+        }
+        char magic[5] = {};
+        std::ifstream file(temp_path.c_str(), std::ios::in | std::ios::binary);
+        file.read(magic, sizeof(magic));
+        return file && std::string(magic, sizeof(magic)) == "#usda";
+    }
+
+    // Compress a downloaded text layer in place, so it takes less space in the local cache.
+    // The layer is decompressed when it is opened, see S3::open_asset.
+    void compress_download(const std::string& temp_path, const Cache& cache) {
+        if (!cache_compression || cache.is_compressed || !is_text_layer(temp_path, cache.local_path)) {
+            return;
+        }
+        const std::string compressed_path = temp_path + ".gz";
+        if (!compress_file(temp_path, compressed_path)) {
+            TF_DEBUG(S3_DBG).Msg("S3: fetch_object failed to compress %s\n", temp_path.c_str());
+            return;
+        }
+        // tiny layers grow by the gzip header, keep those as they are
+        struct stat compressed_stat;
+        if (stat(compressed_path.c_str(), &compressed_stat) != 0 ||
+                static_cast<size_t>(compressed_stat.st_size) >= cache.size ||
+                rename(compressed_path.c_str(), temp_path.c_str()) != 0) {
+            std::remove(compressed_path.c_str());
+        }
+    }
+
+    // Publish a completed download at the local path of the cache entry
+    bool publish_download(const std::string& temp_path, Cache& cache) {
+        compress_download(temp_path, cache);
+        // set the original date modified on the asset
+        struct utimbuf times;
+        times.actime = times.modtime = static_cast<time_t>(cache.timestamp);
+        if (utime(temp_path.c_str(), &times) != 0) {
+            TF_DEBUG(S3_DBG).Msg("S3: fetch_object failed to set the modification time of %s\n", temp_path.c_str());
+        }
+        // store the content once and link the local path to it
+        const std::string blob_path = get_blob_path(cache);
+        if (!blob_path.empty() && rename(temp_path.c_str(), blob_path.c_str()) == 0) {
+            if (link_blob(blob_path, cache.local_path)) {
+                return true;
+            }
+            // no hard links on this file system, the local path keeps the only copy
+            if (rename(blob_path.c_str(), cache.local_path.c_str()) == 0) {
+                return true;
+            }
+            TF_DEBUG(S3_DBG).Msg("S3: fetch_object failed to move %s into place\n", blob_path.c_str());
+            std::remove(blob_path.c_str());
+            return false;
+        }
+        if (rename(temp_path.c_str(), cache.local_path.c_str()) != 0) {
+            TF_DEBUG(S3_DBG).Msg("S3: fetch_object failed to move %s into place\n", temp_path.c_str());
+            std::remove(temp_path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // Link the local path of a cache entry to a blob with the same content,
+    // so identical objects are downloaded and stored once.
+    // Returns false if there is no such blob.
+    bool reuse_blob(const std::string& path, Cache& cache) {
+        const std::string blob_path = get_blob_path(cache);
+        struct stat blob_stat;
+        if (blob_path.empty() || stat(blob_path.c_str(), &blob_stat) != 0 ||
+                !has_object_size(blob_path, blob_stat, cache.size)) {
+            return false;
+        }
+        if (!make_local_dir(cache)) {
+            return false;
+        }
+        if (static_cast<double>(blob_stat.st_mtime) < std::floor(cache.timestamp)) {
+            // the links share the date modified, keep it current for all of them
+            struct utimbuf times;
+            times.actime = times.modtime = static_cast<time_t>(cache.timestamp);
+            utime(blob_path.c_str(), &times);
+        }
+        if (!link_blob(blob_path, cache.local_path)) {
+            return false;
+        }
+        TF_DEBUG(S3_DBG).Msg("S3: fetch_object %s reuses %s\n", path.c_str(), blob_path.c_str());
+        cache.state = CACHE_FETCHED;
+        cache.validated = now();
+        store_index_record(path, cache);
+        add_metric(Counter::DEDUPLICATED_FETCHES);
+        return true;
+    }
+
+    // Finish writing the result of a GET request that was streamed to temp_path
+    // and move it to the local cache path
+    bool store_get_outcome(const std::string& path,
+            const Aws::S3::Model::GetObjectOutcome& get_object_outcome, Cache& cache,
+            const std::string& temp_path) {
+        if (get_object_outcome.IsSuccess())
+        {
+            TF_DEBUG(S3_DBG).Msg("S3: fetch_object %s success\n", path.c_str());
+            // the body is the download stream, close it before moving the file
+            auto& body = get_object_outcome.GetResult().GetBody();
+            body.flush();
+            auto* local_file = dynamic_cast<Aws::FStream*>(&body);
+            if (local_file != nullptr) {
+                local_file->close();
+            }
+            if (body.fail()) {
+                TF_DEBUG(S3_DBG).Msg("S3: fetch_object failed to write %s\n", temp_path.c_str());
+                std::remove(temp_path.c_str());
+                return false;
+            }
+            cache.timestamp = get_object_outcome.GetResult().GetLastModified().SecondsWithMSPrecision();
+            cache.size = static_cast<size_t>(get_object_outcome.GetResult().GetContentLength());
+            cache.decoded_size = 0;
+            cache.etag = get_object_outcome.GetResult().GetETag().c_str();
+            cache.validated = now();
+            cache.is_compressed = parse_content_encoding(
+                get_object_outcome.GetResult().GetContentEncoding().c_str()) != Encoding::IDENTITY;
+            if (cache.is_compressed) {
+                add_metric(Counter::COMPRESSED_FETCHES);
+            }
+            if (!publish_download(temp_path, cache)) {
+                return false;
+            }
+            //TF_DEBUG(S3_DBG).Msg("S3: fetch_object version: %s\n", get_object_outcome.GetResult().GetVersionId().c_str());
+            cache.state = CACHE_FETCHED;
+            store_index_record(path, cache);
+            add_metric(Counter::CACHE_MISSES);
+            TF_DEBUG(S3_DBG).Msg("S3: fetch_object OK %.0f\n", cache.timestamp);
+            return true;
+        }
+        else
+        {
+            std::remove(temp_path.c_str());
+            store_get_error(path, get_object_outcome.GetError(), cache);
+            return false;
+        }
+    }
+
+    // Multipart download settings, see setup()
+    size_t multipart_threshold = 0;
+    size_t multipart_part_size = 0;
+    int multipart_threads = 1;
+
+    // runs the async requests of the clients, see prefetch_object for their priority
+    std::shared_ptr<PriorityExecutor> request_executor;
+    // runs resolve_async and fetch_async, they block on requests that may
+    // complete on the request executor, so they can't share its threads
+    PriorityExecutor* load_executor = nullptr;
+    // caps the download bandwidth of all clients together, nullptr if unlimited
+    std::shared_ptr<Aws::Utils::RateLimits::RateLimiterInterface> bandwidth_limiter;
+
+    // An attempt of a hedged GET, streaming to its own temporary file
+    struct HedgedAttempt {
+        std::string temp_path;
+        MetricsClock::time_point sent_at;
+        std::atomic<bool> has_first_byte{false};
+        std::atomic<bool> is_cancelled{false};
+    };
+
+    // The attempts of a hedged GET, the first one to succeed wins.
+    // An attempt may finish after the fetch that sent it has moved on,
+    // so a losing or failed attempt removes its own download.
+    struct HedgedGet {
+        std::mutex mutex;
+        std::condition_variable cond;
+        HedgedAttempt attempts[2];
+        int sent = 0;
+        int finished = 0;
+        int winner = -1;
+        Aws::S3::Model::GetObjectOutcome outcome;
+    };
+
+    // Send attempt i of a hedged GET on the request executor, the caller holds the mutex
+    void send_hedged_attempt(const std::shared_ptr<Client>& client, const std::shared_ptr<HedgedGet>& hedged,
+            Aws::S3::Model::GetObjectRequest request, int i, const std::string& path, Deadline deadline) {
+        stream_to_file(request, hedged->attempts[i].temp_path);
+        request.SetDataReceivedEventHandler([hedged, i](const Aws::Http::HttpRequest*, Aws::Http::HttpResponse*,
+                long long) {
+            HedgedAttempt& attempt = hedged->attempts[i];
+            if (!attempt.has_first_byte.exchange(true)) {
+                first_byte_latency.record(
+                    std::chrono::duration<double>(MetricsClock::now() - attempt.sent_at).count());
+            }
+        });
+        request.SetContinueRequestHandler([hedged, i, deadline](const Aws::Http::HttpRequest*) {
+            return !hedged->attempts[i].is_cancelled && !is_past(deadline);
+        });
+        ++hedged->sent;
+        const bool submitted = request_executor->submit(Priority::FOREGROUND, [client, hedged, request, i, path]() {
+            HedgedAttempt& attempt = hedged->attempts[i];
+            const auto start = begin_request(Counter::GET_REQUESTS);
+            attempt.sent_at = start;
+            auto outcome = client->s3->GetObject(request);
+            end_get_request(start, path, outcome);
+            std::unique_lock<std::mutex> lock(hedged->mutex);
+            ++hedged->finished;
+            if (hedged->winner < 0 && (outcome.IsSuccess() || hedged->finished == hedged->sent)) {
+                hedged->winner = i;
+                hedged->outcome = std::move(outcome);
+                hedged->attempts[1 - i].is_cancelled = true;
+                hedged->cond.notify_all();
+                return;
+            }
+            lock.unlock();
+            // close the download stream before removing its file
+            outcome = Aws::S3::Model::GetObjectOutcome();
+            std::remove(attempt.temp_path.c_str());
+        });
+        if (!submitted) {
+            // shutting down, the attempt fails without a request
+            ++hedged->finished;
+            if (hedged->winner < 0 && hedged->finished == hedged->sent) {
+                hedged->winner = i;
+                hedged->outcome = Aws::S3::Model::GetObjectOutcome(Aws::Client::AWSError<Aws::S3::S3Errors>(
+                    Aws::S3::S3Errors::INTERNAL_FAILURE, "ShutDown", "the request executor is shut down", false));
+                hedged->cond.notify_all();
+            }
+        }
+    }
+
+    // GET an object into the temporary file at temp_path under the request policy.
+    // With hedging on, an attempt that has no first byte yet when the hedge
+    // quantile of the recent first byte latencies has passed gets a duplicate
+    // that streams to its own file, and the first one to succeed wins.
+    // temp_path is set to the file of the winner.
+    Aws::S3::Model::GetObjectOutcome get_object_to_file(const Cache& cache,
+            Aws::S3::Model::GetObjectRequest& request, const std::string& path, std::string& temp_path) {
+        if (request_policy.hedge_quantile <= 0.0) {
+            stream_to_file(request, temp_path);
+            return get_object(get_client(cache), request, path);
+        }
+        const std::shared_ptr<Client>& client = cache.client ? cache.client : default_client;
+        const Deadline deadline = get_deadline();
+        const std::string base_path = temp_path;
+        for (int attempt = 1;; ++attempt) {
+            auto hedged = std::make_shared<HedgedGet>();
+            hedged->attempts[0].temp_path = base_path;
+            hedged->attempts[1].temp_path = base_path + ".hedge";
+            std::unique_lock<std::mutex> lock(hedged->mutex);
+            send_hedged_attempt(client, hedged, request, 0, path, deadline);
+            // no hedging until there are enough samples for an estimate
+            const double hedge_delay = first_byte_latency.get_quantile(request_policy.hedge_quantile);
+            if (hedge_delay > 0.0 && !hedged->cond.wait_for(lock, std::chrono::duration<double>(hedge_delay),
+                    [&hedged] { return hedged->winner >= 0; }) && !hedged->attempts[0].has_first_byte) {
+                TF_DEBUG(S3_DBG).Msg("S3: hedging %s after %.3fs\n", path.c_str(), hedge_delay);
+                add_metric(Counter::HEDGED_REQUESTS);
+                send_hedged_attempt(client, hedged, request, 1, path, deadline);
+            }
+            hedged->cond.wait(lock, [&hedged] { return hedged->winner >= 0; });
+            if (hedged->winner == 1) {
+                add_metric(Counter::HEDGE_WINS);
+            }
+            temp_path = hedged->attempts[hedged->winner].temp_path;
+            auto outcome = std::move(hedged->outcome);
+            lock.unlock();
+            if (outcome.IsSuccess() || !retry_request(path, outcome.GetError(), attempt, deadline)) {
+                return outcome;
+            }
+        }
+    }
+
+    // Download one byte range of an object into the temporary file at the same offset.
+    // Like get_object, with a short body retried as a network error under the same
+    // attempts and deadline. Every part is tied to the ETag of the HEAD, so the file
+    // can't mix parts of two versions of the object.
+    bool fetch_part(const std::string& path, const Cache& cache, const std::string& temp_path,
+            size_t offset, size_t length) {
+        const std::string range = "bytes=" + std::to_string(offset) + "-" + std::to_string(offset + length - 1);
+        auto object_request = make_get_request(path);
+        object_request.SetRange(range.c_str());
+        if (!cache.etag.empty()) {
+            object_request.SetIfMatch(cache.etag.c_str());
+        }
+        object_request.SetResponseStreamFactory([temp_path, offset]() {
+            return Aws::New<DownloadStream>("s3resolver", temp_path, offset);
+        });
+        const Deadline deadline = get_deadline();
+        set_deadline(object_request, deadline);
+        for (int attempt = 1;; ++attempt) {
+            const auto start = begin_request(Counter::GET_REQUESTS);
+            auto outcome = get_client(cache).GetObject(object_request);
+            end_get_request(start, path, outcome);
+            if (!outcome.IsSuccess()) {
+                if (outcome.GetError().GetResponseCode() == Aws::Http::HttpResponseCode::PRECONDITION_FAILED) {
+                    // the object was replaced since the HEAD, retrying won't help
+                    TF_DEBUG(S3_DBG).Msg("S3: fetch_part %s changed during download\n", path.c_str());
+                    return false;
+                }
+                if (!retry_request(path, outcome.GetError(), attempt, deadline)) {
+                    TF_DEBUG(S3_DBG).Msg("S3: fetch_part %s %s failed after %d attempts: %s\n",
+                        path.c_str(), range.c_str(), attempt, outcome.GetError().GetMessage().c_str());
+                    return false;
+                }
+                continue;
+            }
+            auto& body = outcome.GetResult().GetBody();
+            body.flush();
+            const bool written = !body.fail();
+            const bool complete = static_cast<size_t>(outcome.GetResult().GetContentLength()) == length;
+            // objects without an ETag fall back to the date modified, which has a precision of seconds
+            if (cache.etag.empty() &&
+                    outcome.GetResult().GetLastModified().SecondsWithMSPrecision() != cache.timestamp) {
+                TF_DEBUG(S3_DBG).Msg("S3: fetch_part %s changed during download\n", path.c_str());
+                return false;
+            }
+            if (written && complete) {
+                return true;
+            }
+            TF_DEBUG(S3_DBG).Msg("S3: fetch_part %s %s incomplete, attempt %d\n",
+                path.c_str(), range.c_str(), attempt);
+            const Aws::Client::AWSError<Aws::S3::S3Errors> incomplete(Aws::S3::S3Errors::NETWORK_CONNECTION,
+                "IncompleteBody", "the part is incomplete", true);
+            if (!retry_request(path, incomplete, attempt, deadline)) {
+                return false;
+            }
+        }
+    }
+
+    // Download a large object with concurrent ranged GET requests
+    // The size, timestamp and ETag of the cache come from the HEAD request.
+    bool fetch_object_parts(const std::string& path, Cache& cache) {
+        const std::string temp_path = prepare_download(cache);
+        if (temp_path.empty()) {
+            return false;
+        }
+        // preallocate the file, parts are written at their own offset
+        {
+            Aws::OFStream local_file(temp_path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        }
+        if (truncate(temp_path.c_str(), static_cast<off_t>(cache.size)) != 0) {
+            TF_DEBUG(S3_DBG).Msg("S3: fetch_object failed to allocate %s\n", temp_path.c_str());
+            std::remove(temp_path.c_str());
+            return false;
+        }
+
+        const size_t part_count = (cache.size + multipart_part_size - 1) / multipart_part_size;
+        const size_t thread_count = std::min(part_count, static_cast<size_t>(multipart_threads));
+        TF_DEBUG(S3_DBG).Msg("S3: fetch_object %s in %zu parts on %zu threads\n",
+            path.c_str(), part_count, thread_count);
+
+        std::atomic<size_t> next_part(0);
+        std::atomic<bool> failed(false);
+        auto worker = [&]() {
+            for (size_t part = next_part++; part < part_count && !failed; part = next_part++) {
+                const size_t offset = part * multipart_part_size;
+                const size_t length = std::min(multipart_part_size, cache.size - offset);
+                if (!fetch_part(path, cache, temp_path, offset, length)) {
+                    failed = true;
+                }
+            }
+        };
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < thread_count; ++i) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        if (failed || !publish_download(temp_path, cache)) {
+            S3_WARN("[S3Resolver] failed to download %s in parts", path.c_str());
+            std::remove(temp_path.c_str());
+            return false;
+        }
+        cache.state = CACHE_FETCHED;
+        cache.validated = now();
+        store_index_record(path, cache);
+        add_metric(Counter::CACHE_MISSES);
+        TF_DEBUG(S3_DBG).Msg("S3: fetch_object OK %.0f\n", cache.timestamp);
+        return true;
+    }
+
+    // Check if an object is large enough to download in parts
+    bool use_multipart(const Cache& cache) {
+        return multipart_threshold > 0 && cache.size >= multipart_threshold && cache.size > multipart_part_size;
+    }
+
+    // Memory cache settings, see setup()
+    bool memory_write_through = false;
+
+    // Bytes USD reads from an object, what the memory cache holds of it.
+    // Until a compressed object was decoded, only its encoded size is known.
+    size_t get_decoded_size(const Cache& cache) {
+        return cache.decoded_size > 0 ? cache.decoded_size : cache.size;
+    }
+
+    // Write an object kept in memory to its local path as well,
+    // for other processes sharing the cache path and for later sessions.
+    // content is the body as S3 sent it.
+    bool write_through(const std::string& path, Cache& cache, const std::vector<char>& content) {
+        const std::string temp_path = prepare_download(cache);
+        if (temp_path.empty()) {
+            return false;
+        }
+        {
+            std::ofstream file(temp_path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+            file.write(content.data(), static_cast<std::streamsize>(content.size()));
+            if (!file) {
+                TF_DEBUG(S3_DBG).Msg("S3: fetch_object failed to write %s\n", temp_path.c_str());
+                file.close();
+                std::remove(temp_path.c_str());
+                return false;
+            }
+        }
+        if (!publish_download(temp_path, cache)) {
+            return false;
+        }
+        store_index_record(path, cache);
+        return true;
+    }
+
+    // Download a small object into the memory cache instead of to its local path.
+    // An object that is still in memory is revalidated with a conditional GET.
+    bool fetch_to_memory(const std::string& path, Cache& cache) {
+        MemoryCache::Buffer buffer;
+        size_t size = 0;
+        const bool is_cached = cache.is_in_memory && !cache.etag.empty() &&
+            memory_cache.find(path, cache.etag, buffer, size);
+        auto object_request = make_get_request(path);
+        if (is_cached) {
+            object_request.WithIfNoneMatch(cache.etag.c_str());
+        }
+        MemoryStreamBuf stream_buffer(cache.size);
+        object_request.SetResponseStreamFactory([&stream_buffer]() {
+            stream_buffer.rewind();
+            return Aws::New<Aws::IOStream>("s3resolver", &stream_buffer);
+        });
+        auto outcome = get_object(get_client(cache), object_request, path);
+        if (!outcome.IsSuccess()) {
+            if (is_cached && outcome.GetError().GetResponseCode() == Aws::Http::HttpResponseCode::NOT_MODIFIED) {
+                TF_DEBUG(S3_DBG).Msg("S3: fetch_asset - %s not modified\n", path.c_str());
+                add_metric(Counter::REVALIDATIONS_NOT_MODIFIED);
+                add_metric(Counter::CACHE_HITS);
+                cache.validated = now();
+                return true;
+            }
+            store_get_error(path, outcome.GetError(), cache);
+            return false;
+        }
+        const auto& result = outcome.GetResult();
+        const auto& content = stream_buffer.get_content();
+        if (static_cast<size_t>(result.GetContentLength()) != content->size()) {
+            TF_DEBUG(S3_DBG).Msg("S3: fetch_object %s incomplete, %zu bytes\n", path.c_str(), content->size());
+            return false;
+        }
+        // the memory cache holds what USD reads, compressed objects are decoded once here
+        const Encoding encoding = parse_content_encoding(result.GetContentEncoding().c_str());
+        auto decoded = content;
+        if (encoding != Encoding::IDENTITY) {
+            ScopedTimer timer(Timer::DECOMPRESS, &path);
+            auto decoded_content = std::make_shared<std::vector<char>>();
+            if (!decompress(encoding, content->data(), content->size(), *decoded_content)) {
+                S3_WARN("[S3Resolver] can't decode %s, Content-Encoding %s", path.c_str(),
+                    result.GetContentEncoding().c_str());
+                return false;
+            }
+            add_metric(Counter::COMPRESSED_FETCHES);
+            add_metric(Counter::DECOMPRESSED_BYTES, static_cast<int64_t>(decoded_content->size()));
+            decoded = decoded_content;
+        }
+        cache.timestamp = result.GetLastModified().SecondsWithMSPrecision();
+        cache.size = content->size();
+        cache.decoded_size = decoded->size();
+        cache.etag = result.GetETag().c_str();
+        cache.validated = now();
+        cache.state = CACHE_FETCHED;
+        cache.is_compressed = encoding != Encoding::IDENTITY;
+        cache.is_in_memory = memory_cache.accepts(cache.decoded_size);
+        if (cache.is_in_memory) {
+            // the cache and the assets share the downloaded body
+            memory_cache.insert(path, cache.etag, MemoryCache::Buffer(decoded, decoded->data()), decoded->size());
+            TF_DEBUG(S3_DBG).Msg("S3: fetch_object %s into memory, %zu bytes\n", path.c_str(), cache.decoded_size);
+        } else {
+            // decoded the object is too large for memory, its local path keeps the body as it was sent
+            TF_DEBUG(S3_DBG).Msg("S3: fetch_object %s decodes to %zu bytes, not kept in memory\n",
+                path.c_str(), cache.decoded_size);
+            memory_cache.erase(path);
+            if (!write_through(path, cache, *content)) {
+                cache.state = CACHE_NEEDS_FETCHING;
+                return false;
+            }
+        }
+        if (is_cached) {
+            add_metric(Counter::REVALIDATIONS_CHANGED);
+        }
+        add_metric(Counter::CACHE_MISSES);
+        if (cache.is_in_memory && memory_write_through) {
+            write_through(path, cache, *content);
+        }
+        return true;
+    }
+
+    bool fetch_object(const std::string& path, Cache& cache) {
+        if (default_client == nullptr) {
+            TF_DEBUG(S3_DBG).Msg("S3: fetch_object - abort due to missing client\n");
+            return false;
+        }
+        ScopedTimer timer(Timer::FETCH_OBJECT, &path);
+
+        // small objects skip the local cache path, and its directories and locks
+        if (memory_cache.accepts(get_decoded_size(cache))) {
+            return fetch_to_memory(path, cache);
+        }
+        if (cache.is_in_memory) {
+            // the object outgrew the memory cache
+            memory_cache.erase(path);
+            cache.is_in_memory = false;
+        }
+
+        // one process downloads the object, the others wait and use its result
+        DownloadLock download_lock(path, get_cache_root(cache), true);
+        if (adopt_index_record(path, cache) || reuse_blob(path, cache)) {
+            return true;
+        }
+        if (use_multipart(cache)) {
+            return fetch_object_parts(path, cache);
+        }
+
+        std::string temp_path = prepare_download(cache);
+        if (temp_path.empty()) {
+            return false;
+        }
+        auto object_request = make_get_request(path);
+        // the outcome owns the download stream, it is closed in store_get_outcome
+        auto outcome = get_object_to_file(cache, object_request, path, temp_path);
+        return store_get_outcome(path, outcome, cache, temp_path);
+    }
+
+    // Lazy asset settings, see setup()
+    size_t lazy_threshold = 0;
+    size_t lazy_block_size = 0;
+    size_t lazy_cache_size = 0;
+
+    // Check if an asset is read with range requests instead of being downloaded.
+    // Only crate files qualify: UsdZipFile reads a package through ArAsset::GetBuffer,
+    // which needs the whole object anyway. Ranges of compressed objects can't be decoded.
+    bool is_lazy(const std::string& path, const Cache& cache) {
+        if (lazy_threshold == 0 || cache.state == CACHE_MISSING || cache.size < lazy_threshold || cache.is_compressed) {
+            return false;
+        }
+        const std::string extension = TfGetExtension(get_object_name(path));
+        return extension == "usdc" || extension == "usd";
+    }
+
+    // Dependency prefetch settings, see setup()
+    int prefetch_depth = 0;
+    Aws::Utils::Threading::PooledThreadExecutor* scan_executor = nullptr;
+
+    void scan_dependencies(const std::string& path, const std::string& local_path, int depth);
+
+    // Freshness policy, see setup()
+    double default_ttl = 0.0;
+    std::vector<std::pair<std::string, double>> ttl_rules;  // longest prefix first
+
+    // Number of seconds a fetched object is trusted without asking S3
+    double freshness_ttl(const std::string& path) {
+        for (const auto& rule : ttl_rules) {
+            if (path.compare(0, rule.first.size(), rule.first) == 0) {
+                return rule.second;
+            }
+        }
+        return default_ttl;
+    }
+
+    // Parse TTL rules such as 'bucket/prefix=60;bucket=10'
+    void parse_ttl_rules(const std::string& rules) {
+        ttl_rules.clear();
+        for (const auto& rule : TfStringSplit(rules, ";")) {
+            const auto separator = rule.find_last_of('=');
+            if (separator == std::string::npos || separator == 0) {
+                continue;
+            }
+            ttl_rules.emplace_back(rule.substr(0, separator), std::atof(rule.substr(separator + 1).c_str()));
+        }
+        std::sort(ttl_rules.begin(), ttl_rules.end(),
+            [](const std::pair<std::string, double>& a, const std::pair<std::string, double>& b) {
+                return a.first.size() > b.first.size();
+            });
+    }
+
+    // Check a fetched object for changes and download it again if it changed.
+    // Uses a conditional GET, so an unchanged object costs a single request
+    // without a body. Large objects are checked with a HEAD before downloading
+    // them in parts. On failure the cache entry is only missing if the object is.
+    bool refresh_object(const std::string& path, Cache& cache) {
+        if (cache.is_in_memory && memory_cache.accepts(get_decoded_size(cache))) {
+            return fetch_to_memory(path, cache);
+        }
+        if (use_multipart(cache)) {
+            Cache remote = cache;
+            if (check_object(path, remote).empty()) {
+                if (remote.state == CACHE_MISSING) {
+                    cache = remote;
+                }
+                return false;
+            }
+            if (remote.etag == cache.etag && remote.timestamp == cache.timestamp) {
+                add_metric(Counter::REVALIDATIONS_NOT_MODIFIED);
+                add_metric(Counter::CACHE_HITS);
+                cache.validated = now();
+                store_index_record(path, cache);
+                return true;
+            }
+            TF_DEBUG(S3_DBG).Msg("S3: fetch_asset - local path data is out of date\n");
+            add_metric(Counter::REVALIDATIONS_CHANGED);
+            cache = remote;
+            return fetch_object(path, cache);
+        }
+
+        // one process revalidates the object, the others use its result
+        DownloadLock download_lock(path, get_cache_root(cache), true);
+        if (adopt_index_record(path, cache)) {
+            add_metric(Counter::CACHE_HITS);
+            return true;
+        }
+        std::string temp_path = prepare_download(cache);
+        if (temp_path.empty()) {
+            return false;
+        }
+        auto object_request = make_get_request(path);
+        if (!cache.etag.empty()) {
+            object_request.WithIfNoneMatch(cache.etag.c_str());
+        } else {
+            object_request.WithIfModifiedSince(Aws::Utils::DateTime(static_cast<int64_t>(cache.timestamp * 1000.0)));
+        }
+        auto get_object_outcome = get_object_to_file(cache, object_request, path, temp_path);
+        if (!get_object_outcome.IsSuccess() &&
+                get_object_outcome.GetError().GetResponseCode() == Aws::Http::HttpResponseCode::NOT_MODIFIED) {
+            TF_DEBUG(S3_DBG).Msg("S3: fetch_asset - %s not modified\n", path.c_str());
+            std::remove(temp_path.c_str());
+            add_metric(Counter::REVALIDATIONS_NOT_MODIFIED);
+            add_metric(Counter::CACHE_HITS);
+            cache.validated = now();
+            store_index_record(path, cache);
+            return true;
+        }
+
+        TF_DEBUG(S3_DBG).Msg("S3: fetch_asset - local path data is out of date\n");
+        const bool success = store_get_outcome(path, get_object_outcome, cache, temp_path);
+        if (success) {
+            add_metric(Counter::REVALIDATIONS_CHANGED);
+        }
+        return success;
+    }
+
+    // Revalidate a fetched object, see refresh_object.
+    // A transient error or an exceeded deadline doesn't make an asset missing:
+    // the cached copy is served as it is, and as it isn't validated, the next
+    // fetch checks it again.
+    bool revalidate_object(const std::string& path, Cache& cache) {
+        Cache refreshed = cache;
+        if (refresh_object(path, refreshed) || refreshed.state == CACHE_MISSING) {
+            cache = refreshed;
+            return cache.state != CACHE_MISSING;
+        }
+        TF_DEBUG(S3_DBG).Msg("S3: fetch_asset - can't revalidate %s, using the cached copy\n", path.c_str());
+        return false;
+    }
+
+    // Shared state of a prefetch call, counts the assets that are still in flight
+    struct Prefetch {
+        std::mutex mutex;
+        std::condition_variable cond;
+        size_t pending = 0;
+        size_t fetched = 0;
+        int depth = 0;              // number of dependency levels to follow from the fetched layers
+        bool speculative = false;   // started by a dependency scan instead of a prefetch call
+    };
+
+    // Called on the executor when the download of a prefetched asset is done
+    void finish_prefetch(const std::string& path, const std::shared_ptr<Prefetch>& prefetch,
+            const std::shared_ptr<CacheEntry>& entry, Cache& cache, bool success) {
+        {
+            std::unique_lock<std::mutex> lock(entry->mutex);
+            // the next fetch_asset can trust this result without checking for updates
+            cache.is_fresh = success;
+            cache.is_speculative = success && prefetch->speculative;
+            if (success && prefetch->depth > 0 && is_layer(path)) {
+                cache.is_scanned = true;
+                scan_dependencies(path, cache.local_path, prefetch->depth);
+            }
+            finish_in_flight(*entry, lock, cache);
+        }
+        if (success && prefetch->speculative) {
+            add_metric(Counter::SPECULATIVE_FETCHES);
+        }
+        std::lock_guard<std::mutex> lock(prefetch->mutex);
+        if (success) {
+            ++prefetch->fetched;
+        }
+        if (--prefetch->pending == 0) {
+            prefetch->cond.notify_all();
+        }
+    }
+
+    // Finish a prefetch whose request couldn't be submitted, the request executor is shut down
+    void abandon_prefetch(const std::string& path, const std::shared_ptr<Prefetch>& prefetch,
+            const std::shared_ptr<CacheEntry>& entry, const Cache& cache) {
+        TF_DEBUG(S3_DBG).Msg("S3: prefetch of %s abandoned, shutting down\n", path.c_str());
+        Cache result = cache;
+        finish_prefetch(path, prefetch, entry, result, false);
+    }
+
+    // Download an asset that was resolved by prefetch_object
+    void prefetch_get(const std::string& path, const std::shared_ptr<Prefetch>& prefetch,
+            const std::shared_ptr<CacheEntry>& entry, const Cache& cache) {
+        if (memory_cache.accepts(get_decoded_size(cache))) {
+            // there is no file to stream to, small objects are fetched with blocking requests
+            const bool submitted = request_executor->Submit([path, prefetch, entry, cache]() {
+                Cache result = cache;
+                const bool success = fetch_to_memory(path, result);
+                if (!success) {
+                    result.state = CACHE_NEEDS_FETCHING;
+                }
+                finish_prefetch(path, prefetch, entry, result, success);
+            });
+            if (!submitted) {
+                abandon_prefetch(path, prefetch, entry, cache);
+            }
+            return;
+        }
+        // don't wait for other processes on the prefetch threads,
+        // the fetch of the asset waits for them if it needs to
+        auto download_lock = std::make_shared<DownloadLock>(path, get_cache_root(cache), false);
+        Cache reused = cache;
+        if (download_lock->busy() || adopt_index_record(path, reused) || reuse_blob(path, reused)) {
+            finish_prefetch(path, prefetch, entry, reused, reused.state == CACHE_FETCHED);
+            return;
+        }
+        if (use_multipart(cache)) {
+            // the parts are fetched with blocking requests on their own threads
+            const bool submitted = request_executor->Submit([path, prefetch, entry, cache, download_lock]() {
+                Cache result = cache;
+                const bool success = fetch_object_parts(path, result);
+                if (!success) {
+                    result.state = CACHE_NEEDS_FETCHING;
+                }
+                finish_prefetch(path, prefetch, entry, result, success);
+            });
+            if (!submitted) {
+                abandon_prefetch(path, prefetch, entry, cache);
+            }
+            return;
+        }
+        const std::string temp_path = prepare_download(cache);
+        if (temp_path.empty()) {
+            Cache result = cache;
+            finish_prefetch(path, prefetch, entry, result, false);
+            return;
+        }
+        auto object_request = make_get_request(path);
+        stream_to_file(object_request, temp_path);
+        // like GetObjectAsync, which doesn't tell when the executor refuses the request.
+        // Retried under the request policy, but not hedged: the attempts would wait for
+        // threads of the executor this runs on.
+        const bool submitted = request_executor->Submit([path, prefetch, entry, cache, temp_path, download_lock,
+                object_request]() mutable {
+            const auto outcome = get_object(get_client(cache), object_request, path);
+            Cache result = cache;
+            result.state = CACHE_MISSING; // we'll set this up if fetching is successful
+            const bool success = store_get_outcome(path, outcome, result, temp_path);
+            if (!success) {
+                result.state = CACHE_NEEDS_FETCHING;
+            }
+            finish_prefetch(path, prefetch, entry, result, success);
+        });
+        if (!submitted) {
+            std::remove(temp_path.c_str());
+            abandon_prefetch(path, prefetch, entry, cache);
+        }
+    }
+
+    // Resolve and download a single asset without blocking.
+    // Returns false if there is nothing to do for this asset.
+    bool prefetch_object(const std::string& path, const std::shared_ptr<Prefetch>& prefetch) {
+        // the requests and the callbacks they chain queue behind more urgent ones
+        PriorityExecutor::ScopedPriority scoped_priority(prefetch->speculative ? Priority::SPECULATIVE :
+            Priority::BACKGROUND);
+        auto entry = get_cache_entry(path);
+        std::unique_lock<std::mutex> lock(entry->mutex);
+        if (entry->in_flight) {
+            // another thread owns this asset, prefetch waits for it at the end
+            return false;
+        }
+        if (entry->cache.state == CACHE_FETCHED) {
+            if (prefetch->depth > 0 && !entry->cache.is_scanned && is_layer(path)) {
+                entry->cache.is_scanned = true;
+                scan_dependencies(path, entry->cache.local_path, prefetch->depth);
+            }
+            return false;
+        }
+        if (is_known_missing(entry->cache)) {
+            return false;
+        }
+        entry->in_flight = true;
+        Cache cache = entry->cache;
+        lock.unlock();
+
+        if (cache.state == CACHE_NEEDS_FETCHING) {
+            double local_date_modified;
+            if (is_local_current(cache.local_path, cache.timestamp, local_date_modified)) {
+                TF_DEBUG(S3_DBG).Msg("S3: prefetch - reuse local cache for %s\n", path.c_str());
+                cache.is_fresh = true;
+                finish_in_flight(*entry, lock, cache);
+                return false;
+            }
+            prefetch_get(path, prefetch, entry, cache);
+            return true;
+        }
+
+        if (resolve_listed(path, cache)) {
+            if (cache.state == CACHE_MISSING) {
+                finish_prefetch(path, prefetch, entry, cache, false);
+            } else {
+                prefetch_get(path, prefetch, entry, cache);
+            }
+            return true;
+        }
+        auto head_request = make_head_request(path, cache);
+        const bool submitted = request_executor->Submit([path, prefetch, entry, cache, head_request]() mutable {
+            const auto outcome = head_object(get_client(cache), head_request, path);
+            Cache result = cache;
+            if (store_head_outcome(path, outcome, result).empty()) {
+                finish_prefetch(path, prefetch, entry, result, false);
+            } else {
+                prefetch_get(path, prefetch, entry, result);
+            }
+        });
+        if (!submitted) {
+            abandon_prefetch(path, prefetch, entry, cache);
+        }
+        return true;
+    }
+
+    // Anchor an asset path found in a layer to the S3 path of that layer
+    // e.g. './chair.usd' in 'bucket/set/room.usd' returns 's3:bucket/set/chair.usd'
+    std::string anchor_dependency(const std::string& path, const std::string& asset_path) {
+        if (asset_path.compare(0, cexpr_strlen(S3_PREFIX_SHORT), S3_PREFIX_SHORT) == 0) {
+            return asset_path;
+        }
+        if (asset_path.compare(0, 2, "./") != 0 && asset_path.compare(0, 3, "../") != 0) {
+            // search paths and absolute paths are left to the default resolver
+            return std::string();
+        }
+        const std::string parent = get_bucket_name(path) + "/" + get_object_name(path);
+        const std::string dir = parent.substr(0, parent.find_last_of('/') + 1);
+        const std::string anchored = TfNormPath(dir + asset_path);
+        if (anchored.compare(0, 3, "../") == 0 || anchored.find('/') == std::string::npos) {
+            // path escapes the bucket
+            return std::string();
+        }
+        return std::string(S3_PREFIX_SHORT) + anchored;
+    }
+
+    // Scan a fetched layer on the scan executor for sublayers, references and payloads
+    // on S3 and start fetching them, depth is the number of levels left to follow.
+    void scan_dependencies(const std::string& path, const std::string& local_path, int depth) {
+        if (scan_executor == nullptr || depth <= 0) {
+            return;
+        }
+        TF_DEBUG(S3_DBG).Msg("S3: scan_dependencies %s depth %d\n", path.c_str(), depth);
+        scan_executor->Submit([path, local_path, depth]() {
+            std::vector<std::string> sublayers, references, payloads;
+            UsdUtilsExtractExternalReferences(local_path, &sublayers, &references, &payloads);
+            add_metric(Counter::SCANNED_LAYERS);
+
+            // files inside a usdz package are relative to the package, not to the bucket
+            const bool is_package = TfGetExtension(get_object_name(path)) == "usdz";
+            std::vector<std::string> dependencies;
+            for (const auto* asset_paths : {&sublayers, &references, &payloads}) {
+                for (const auto& asset_path : *asset_paths) {
+                    const std::string anchored = is_package ?
+                        (asset_path.compare(0, cexpr_strlen(S3_PREFIX_SHORT), S3_PREFIX_SHORT) == 0 ? asset_path : std::string()) :
+                        anchor_dependency(path, asset_path);
+                    if (!anchored.empty()) {
+                        dependencies.push_back(get_endpoint_prefix(path) + parse_path(anchored));
+                    }
+                }
+            }
+            std::sort(dependencies.begin(), dependencies.end());
+            dependencies.erase(std::unique(dependencies.begin(), dependencies.end()), dependencies.end());
+            TF_DEBUG(S3_DBG).Msg("S3: scan_dependencies %s found %zu s3 dependencies\n",
+                path.c_str(), dependencies.size());
+
+            // nobody waits for speculative fetches, they finish in the background
+            auto prefetch = std::make_shared<Prefetch>();
+            prefetch->depth = depth - 1;
+            prefetch->speculative = true;
+            prefetch->pending = dependencies.size() + 1;
+            for (const auto& dependency : dependencies) {
+                if (!prefetch_object(dependency, prefetch)) {
+                    std::lock_guard<std::mutex> lock(prefetch->mutex);
+                    --prefetch->pending;
+                }
+            }
+            std::lock_guard<std::mutex> lock(prefetch->mutex);
+            --prefetch->pending;
+        });
+    }
+
+    // Strip the scheme off an endpoint
+    // e.g. 'https://s3.example.com:9000' returns 's3.example.com:9000'
+    std::string get_endpoint_host(const std::string& endpoint) {
+        const auto i = endpoint.find("://");
+        return i == std::string::npos ? endpoint : endpoint.substr(i + 3);
+    }
+
+    // Fill in the settings a config leaves empty from the environment
+    ClientConfig merge_config(const ClientConfig& config) {
+        ClientConfig merged = config;
+        if (merged.endpoint.empty()) {
+            merged.endpoint = default_config.endpoint;
+        }
+        if (merged.region.empty()) {
+            merged.region = default_config.region;
+        }
+        if (merged.profile.empty()) {
+            merged.profile = default_config.profile;
+        }
+        if (merged.cache_path.empty()) {
+            merged.cache_path = default_config.cache_path;
+        }
+        if (merged.connect_timeout_ms <= 0) {
+            merged.connect_timeout_ms = default_config.connect_timeout_ms;
+        }
+        if (merged.request_timeout_ms <= 0) {
+            merged.request_timeout_ms = default_config.request_timeout_ms;
+        }
+        if (merged.max_connections == 0) {
+            merged.max_connections = default_config.max_connections;
+        }
+        return merged;
+    }
+
+    std::shared_ptr<Client> make_client(const ClientConfig& config) {
+        TF_DEBUG(S3_DBG).Msg("S3: client setup for '%s', %u connections\n",
+            config.endpoint.c_str(), config.max_connections);
+        Aws::Client::ClientConfiguration client_config;
+        // async requests (prefetch) of all clients run on one bounded pool
+        client_config.executor = request_executor;
+        client_config.maxConnections = config.max_connections;
+        const bool is_https = config.endpoint.compare(0, 8, "https://") == 0;
+        client_config.scheme = Aws::Http::SchemeMapper::FromString(is_https ? "https" : "http");
+        client_config.endpointOverride = get_endpoint_host(config.endpoint).c_str();
+        if (!config.region.empty()) {
+            client_config.region = config.region.c_str();
+        }
+        client_config.proxyHost = get_env_var(PROXY_HOST_ENV_VAR, "").c_str();
+        client_config.proxyPort = atoi(get_env_var(PROXY_PORT_ENV_VAR, "80").c_str());
+        client_config.connectTimeoutMs = config.connect_timeout_ms;
+        client_config.requestTimeoutMs = config.request_timeout_ms;
+        // failed requests are retried by the request policy, see retry_request
+        client_config.retryStrategy = Aws::MakeShared<Aws::Client::DefaultRetryStrategy>("s3resolver", 0);
+        client_config.readRateLimiter = bandwidth_limiter;
+
+        std::shared_ptr<Aws::Auth::AWSCredentialsProvider> credentials;
+        if (config.profile.empty()) {
+            credentials = Aws::MakeShared<Aws::Auth::DefaultAWSCredentialsProviderChain>("s3resolver");
+        } else {
+            credentials = Aws::MakeShared<Aws::Auth::ProfileConfigFileAWSCredentialsProvider>("s3resolver",
+                config.profile.c_str());
+        }
+        auto client = std::make_shared<Client>();
+        // objects on the default endpoint keep their plain parsed paths
+        client->endpoint = config.endpoint == default_config.endpoint ? std::string() : get_endpoint_host(config.endpoint);
+        client->cache_path = config.cache_path;
+        if (config.cache_path != cache_dir) {
+            make_cache_dirs(config.cache_path);
+        }
+        // S3 compatible stores behind a custom endpoint usually don't have virtual host DNS
+        client->s3 = Aws::New<Aws::S3::S3Client>("s3resolver", credentials, client_config,
+            Aws::Client::AWSAuthV4Signer::PayloadSigningPolicy::Never, config.endpoint.empty());
+        return client;
+    }
+
+    // Get the client of a config from the pool, creating it on first use
+    std::shared_ptr<Client> get_pooled_client(const ClientConfig& config) {
+        const ClientConfig merged = merge_config(config);
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        auto& client = clients[get_config_key(merged)];
+        if (!client) {
+            client = make_client(merged);
+        }
+        return client;
+    }
+
+    std::string get_config_key(const ClientConfig& config) {
+        return config.endpoint + "\n" + config.region + "\n" + config.profile + "\n" + config.cache_path + "\n" +
+            std::to_string(config.connect_timeout_ms) + "\n" + std::to_string(config.request_timeout_ms) + "\n" +
+            std::to_string(config.max_connections);
+    }
+
+    // Set up the SDK, the default client and the settings, see ensure_setup
+    void setup() {
+        TF_DEBUG(S3_DBG).Msg("S3: client setup \n");
+        Aws::InitAPI(options);
+
+        // async requests (prefetch) run on a bounded pool
+        const int prefetch_threads = std::max(1, atoi(get_env_var(PREFETCH_THREADS_ENV_VAR, "16").c_str()));
+        request_executor = Aws::MakeShared<PriorityExecutor>("s3resolver", prefetch_threads);
+        load_executor = Aws::New<PriorityExecutor>("s3resolver", prefetch_threads);
+
+        // downloads share one bandwidth budget in bytes per second
+        const size_t bandwidth_limit = std::strtoull(get_env_var(BANDWIDTH_LIMIT_ENV_VAR, "0").c_str(), nullptr, 10);
+        if (bandwidth_limit > 0) {
+            bandwidth_limiter = Aws::MakeShared<Aws::Utils::RateLimits::DefaultRateLimiter<>>("s3resolver",
+                static_cast<int64_t>(bandwidth_limit));
+        }
+
+        cache_dir = get_env_var(CACHE_PATH_ENV_VAR, "/tmp");
+        if (!TfIsDir(cache_dir)) {
+            TfMakeDirs(cache_dir);
+        }
+
+        // resolver contexts override these settings
+        default_config.endpoint = get_env_var(ENDPOINT_ENV_VAR, "");
+        default_config.region = get_env_var(REGION_ENV_VAR, "");
+        default_config.cache_path = cache_dir;
+        default_config.connect_timeout_ms = std::max(1, atoi(get_env_var(CONNECT_TIMEOUT_ENV_VAR, "3000").c_str()));
+        default_config.request_timeout_ms = std::max(1, atoi(get_env_var(REQUEST_TIMEOUT_ENV_VAR, "3000").c_str()));
+        default_config.max_connections = std::max(1, atoi(get_env_var(MAX_CONNECTIONS_ENV_VAR,
+            std::to_string(prefetch_threads)).c_str()));
+        default_client = get_pooled_client(default_config);
+        // the index is read once here, lookups only hash their key
+        cache_index.open(cache_dir);
+        make_cache_dirs(cache_dir);
+        // the cache is trimmed to its budget on a background thread
+        cache_manager.start(std::strtoull(get_env_var(CACHE_SIZE_ENV_VAR, "0").c_str(), nullptr, 10),
+            cache_index, evict_object);
+
+        // missing objects are not checked again for a while
+        negative_ttl = std::atof(get_env_var(NEGATIVE_TTL_ENV_VAR, "30").c_str());
+
+        // failed requests are retried with a jittered backoff, slow GETs may be hedged
+        request_policy.max_attempts = std::max(1, atoi(get_env_var(MAX_ATTEMPTS_ENV_VAR, "4").c_str()));
+        request_policy.base_delay = std::max(0.0, std::atof(get_env_var(RETRY_DELAY_ENV_VAR, "50").c_str())) / 1000.0;
+        request_policy.max_delay = std::max(request_policy.base_delay,
+            std::atof(get_env_var(RETRY_MAX_DELAY_ENV_VAR, "2000").c_str()) / 1000.0);
+        request_policy.deadline = std::max(0.0, std::atof(get_env_var(REQUEST_DEADLINE_ENV_VAR, "0").c_str())) / 1000.0;
+        request_policy.hedge_quantile = std::min(1.0,
+            std::max(0.0, std::atof(get_env_var(HEDGE_QUANTILE_ENV_VAR, "0").c_str())));
+
+        // small objects are kept in memory instead of in the local cache path
+        memory_cache.configure(std::strtoull(get_env_var(MEMORY_CACHE_SIZE_ENV_VAR, "0").c_str(), nullptr, 10),
+            std::strtoull(get_env_var(MEMORY_THRESHOLD_ENV_VAR, "65536").c_str(), nullptr, 10));
+        memory_write_through = atoi(get_env_var(MEMORY_WRITE_THROUGH_ENV_VAR, "0").c_str()) != 0;
+
+        // text layers are stored gzip compressed in the local cache
+        cache_compression = atoi(get_env_var(CACHE_COMPRESSION_ENV_VAR, "0").c_str()) != 0;
+
+        // objects under these prefixes are resolved by listing the prefix
+        for (const auto& prefix : TfStringSplit(get_env_var(LIST_PREFIXES_ENV_VAR, ""), ";")) {
+            if (!prefix.empty()) {
+                prefix_listings.emplace_back(new PrefixListing());
+                prefix_listings.back()->prefix = matches_schema(prefix) ? parse_path(prefix) : prefix;
+            }
+        }
+        std::sort(prefix_listings.begin(), prefix_listings.end(),
+            [](const std::unique_ptr<PrefixListing>& a, const std::unique_ptr<PrefixListing>& b) {
+                return a->prefix.size() > b->prefix.size();
+            });
+
+        // fetched objects are trusted for a while before they are revalidated
+        default_ttl = std::atof(get_env_var(TTL_ENV_VAR, "0").c_str());
+        parse_ttl_rules(get_env_var(TTL_RULES_ENV_VAR, ""));
+
+        // large objects are downloaded with concurrent ranged GETs
+        multipart_threshold = std::strtoull(get_env_var(MULTIPART_THRESHOLD_ENV_VAR, "67108864").c_str(), nullptr, 10);
+        multipart_part_size = std::max<size_t>(1 << 20,
+            std::strtoull(get_env_var(MULTIPART_PART_SIZE_ENV_VAR, "16777216").c_str(), nullptr, 10));
+        multipart_threads = std::max(1, atoi(get_env_var(MULTIPART_THREADS_ENV_VAR, "8").c_str()));
+
+        // large crate files are read on demand with range requests
+        lazy_threshold = std::strtoull(get_env_var(LAZY_THRESHOLD_ENV_VAR, "0").c_str(), nullptr, 10);
+        lazy_block_size = std::max<size_t>(4096,
+            std::strtoull(get_env_var(LAZY_BLOCK_SIZE_ENV_VAR, "262144").c_str(), nullptr, 10));
+        lazy_cache_size = std::strtoull(get_env_var(LAZY_CACHE_SIZE_ENV_VAR, "67108864").c_str(), nullptr, 10);
+
+        // large text layers are opened as a placeholder while they download
+        progressive_threshold = std::strtoull(get_env_var(PROGRESSIVE_THRESHOLD_ENV_VAR, "0").c_str(), nullptr, 10);
+
+        // fetched layers are scanned for more s3 dependencies on a separate pool,
+        // so parsing doesn't hold up the download threads
+        prefetch_depth = std::max(0, atoi(get_env_var(PREFETCH_DEPTH_ENV_VAR, "0").c_str()));
+        if (prefetch_depth > 0) {
+            const int scan_threads = std::max(1, atoi(get_env_var(PREFETCH_SCAN_THREADS_ENV_VAR, "2").c_str()));
+            scan_executor = Aws::New<Aws::Utils::Threading::PooledThreadExecutor>("s3resolver", scan_threads);
+        }
+    }
+
+    void teardown() {
+        const Metrics metrics = get_metrics();
+        TF_DEBUG(S3_DBG).Msg("S3: client teardown, %zu layers scanned, %zu of %zu speculative fetches used\n",
+            metrics.get(Counter::SCANNED_LAYERS), metrics.get(Counter::SPECULATIVE_HITS),
+            metrics.get(Counter::SPECULATIVE_FETCHES));
+        TF_DEBUG(S3_DBG).Msg("S3: %zu revalidations avoided, %zu not modified, %zu changed\n",
+            metrics.get(Counter::REVALIDATIONS_AVOIDED), metrics.get(Counter::REVALIDATIONS_NOT_MODIFIED),
+            metrics.get(Counter::REVALIDATIONS_CHANGED));
+        TF_DEBUG(S3_DBG).Msg("S3: %zu cache hits, %zu misses, %zu evictions\n",
+            metrics.get(Counter::CACHE_HITS), metrics.get(Counter::CACHE_MISSES), cache_manager.get_evictions());
+        cache_manager.stop();
+        // the executors join their threads, which may still submit requests
+        Aws::Delete(load_executor);
+        load_executor = nullptr;
+        Aws::Delete(scan_executor);
+        scan_executor = nullptr;
+        // the requests still queued run, with their callbacks, while the SDK is up
+        request_executor->shutdown();
+        // the clients must go before the SDK shuts down
+        cached_requests.clear();
+        bound_clients.clear();
+        {
+            std::lock_guard<std::mutex> lock(clients_mutex);
+            clients.clear();
+        }
+        default_client.reset();
+        request_executor.reset();
+        Aws::ShutdownAPI(options);
+    }
+
+    std::once_flag setup_flag;
+
+    // The SDK and the clients are set up on the first use of an s3 path, so
+    // processes that never touch one don't pay for the credential chain lookup.
+    // The teardown is registered after Aws::InitAPI, so it runs at exit before
+    // the static objects the SDK created are destroyed.
+    void ensure_setup() {
+        std::call_once(setup_flag, []() {
+            setup();
+            std::atexit(teardown);
+        });
+    }
+
+    S3::S3() {
+    }
+
+    S3::~S3() {
+    }
+
+    // Send the requests of the assets resolved on this thread to the client
+    // of a resolver context, until it is unbound
+    void S3::bind_config(const ClientConfig& config) {
+        ensure_setup();
+        if (default_client == nullptr) {
+            return;
+        }
+        // the client is created here, so the first resolve in the context doesn't pay for it
+        bound_clients.push_back(get_pooled_client(config));
+    }
+
+    void S3::unbind_config() {
+        if (!bound_clients.empty()) {
+            bound_clients.pop_back();
+        }
+    }
+
+    // The parsed path of a resolved asset, the asset path alone misses the
+    // endpoint of the resolver context it was resolved in
+    void assign_found_path(const std::string& asset_path, const std::string& local_path, std::string& path) {
+        tbb::concurrent_hash_map<std::string, std::string>::const_accessor accessor;
+        if (local_paths.find(accessor, local_path)) {
+            path.assign(accessor->second);
+        } else {
+            assign_path(asset_path, path);
+        }
+    }
+
+    std::string find_path(const std::string& asset_path, const std::string& local_path) {
+        std::string path;
+        assign_found_path(asset_path, local_path, path);
+        return path;
+    }
+
+    // find_path in a buffer of the calling thread, see make_path_key
+    const std::string& find_path_key(const std::string& asset_path, const std::string& local_path) {
+        thread_local std::string path;
+        assign_found_path(asset_path, local_path, path);
+        return path;
+    }
+
+    // Resolve an asset path such as 's3://hello/world.usd'
+    // Checks if the asset exists and returns a local path for the asset
+    std::string S3::resolve_name(const std::string& asset_path) {
+        ensure_setup();
+        // cached resolves don't allocate, apart from the result
+        const std::string& path = make_path_key(asset_path);
+        ScopedTimer timer(Timer::RESOLVE_NAME, &path);
+        TF_DEBUG(S3_DBG).Msg("S3: resolve_name %s\n", path.c_str());
+        auto entry = get_cache_entry(path);
+        std::unique_lock<std::mutex> lock(entry->mutex);
+        if (wait_in_flight(*entry, lock)) {
+            TF_DEBUG(S3_DBG).Msg("S3: resolve_name - use shared result for %s\n", path.c_str());
+            return entry->cache.state != CACHE_MISSING ? entry->cache.local_path : std::string();
+        }
+        if (entry->cache.state != CACHE_MISSING) {
+            TF_DEBUG(S3_DBG).Msg("S3: resolve_name - use cached result for %s\n", path.c_str());
+            return entry->cache.local_path;
+        }
+        if (is_known_missing(entry->cache)) {
+            TF_DEBUG(S3_DBG).Msg("S3: resolve_name - %s is known to be missing\n", path.c_str());
+            add_metric(Counter::NEGATIVE_HITS);
+            return std::string();
+        }
+        TF_DEBUG(S3_DBG).Msg("S3: resolve_name - refresh cached result for %s\n", path.c_str());
+
+        // send the HEAD request without holding the lock,
+        // concurrent resolves of this asset wait for its result
+        entry->in_flight = true;
+        Cache cache = entry->cache;
+        lock.unlock();
+        std::string result;
+        if (resolve_listed(path, cache)) {
+            result = cache.state != CACHE_MISSING ? cache.local_path : std::string();
+        } else {
+            result = check_object(path, cache);
+        }
+        finish_in_flight(*entry, lock, cache);
+        return result;
+    }
+
+    // Fetch an asset to a local path
+    // The asset should be resolved first and exist in the cache
+    bool S3::fetch_asset(const std::string& asset_path, const std::string& local_path) {
+        ensure_setup();
+        const auto path = find_path(asset_path, local_path);
+        ScopedTimer timer(Timer::FETCH_ASSET, &path);
+        TF_DEBUG(S3_DBG).Msg("S3: fetch_asset %s\n", path.c_str());
+        if (default_client == nullptr) {
+            TF_DEBUG(S3_DBG).Msg("S3: fetch_asset - abort due to missing client\n");
+            return false;
+        }
+
+        auto entry = find_cache_entry(path);
+        if (!entry) {
+            S3_WARN("[S3Resolver] %s was not resolved before fetching!", path.c_str());
+            return false;
+        }
+
+        std::unique_lock<std::mutex> lock(entry->mutex);
+        const bool is_fresh = wait_in_flight(*entry, lock) || entry->cache.is_fresh;
+        entry->in_flight = true;
+        Cache cache = entry->cache;
+        cache.is_fresh = false;
+        if (cache.is_speculative) {
+            add_metric(Counter::SPECULATIVE_HITS);
+            cache.is_speculative = false;
+        }
+        lock.unlock();
+
+        if (cache.state == CACHE_MISSING && !is_known_missing(cache)) {
+            // the asset was missing when it was resolved, check again
+            check_object(path, cache);
+        } else if (!is_fresh && cache.state == CACHE_FETCHED && !cache.is_pinned) {
+            // ensure cache state is up to date
+            // there is no guarantee that get_timestamp was called prior to fetch
+            // note that pinned assets don't get updates
+            const double ttl = freshness_ttl(path);
+            if (ttl > 0.0 && now() - cache.validated < ttl) {
+                TF_DEBUG(S3_DBG).Msg("S3: fetch_asset - fresh for another %.0fs, no revalidation\n",
+                    ttl - (now() - cache.validated));
+                add_metric(Counter::REVALIDATIONS_AVOIDED);
+                add_metric(Counter::CACHE_HITS);
+            } else {
+                // downloads the object only if it changed
+                revalidate_object(path, cache);
+            }
+        }
+
+        bool success = true;
+        if (cache.state == CACHE_MISSING) {
+            TF_DEBUG(S3_DBG).Msg("S3: fetch_asset - asset not found, no fetch\n");
+            success = false;
+        } else if (cache.state == CACHE_NEEDS_FETCHING) {
+            double local_date_modified;
+            if (is_local_current(local_path, cache.timestamp, local_date_modified)) {
+                TF_DEBUG(S3_DBG).Msg("S3: fetch_asset - no changes, reuse local cache %.0f >= %.0f\n",
+                        local_date_modified, cache.timestamp);
+                cache.state = CACHE_FETCHED;
+                cache.validated = now();
+                store_index_record(path, cache);
+                add_metric(Counter::CACHE_HITS);
+            } else if (is_lazy(path, cache)) {
+                // OpenAsset reads the parts USD touches with range requests
+                TF_DEBUG(S3_DBG).Msg("S3: fetch_asset - lazy asset, no fetch\n");
+            } else {
+                TF_DEBUG(S3_DBG).Msg("S3: fetch_asset - cache needed fetching\n");
+                cache.state = CACHE_MISSING; // we'll set this up if fetching is successful
+                success = fetch_object(path, cache);
+            }
+        } else {
+            TF_DEBUG(S3_DBG).Msg("S3: fetch_asset - cache does not need fetch\n");
+            cache_manager.touch(path);
+            add_metric(Counter::CACHE_HITS);
+        }
+
+        if (success && prefetch_depth > 0 && !cache.is_scanned && is_layer(path) &&
+                cache.state == CACHE_FETCHED) {
+            // start fetching the dependencies before USD gets to them
+            cache.is_scanned = true;
+            scan_dependencies(path, local_path, prefetch_depth);
+        }
+
+        finish_in_flight(*entry, lock, cache);
+        return success;
+    }
+
+    // Resolve and fetch a set of parsed paths concurrently on the client's executor.
+    // Returns the number of assets that are available locally afterwards.
+    size_t prefetch_paths(const std::vector<std::string>& paths, int depth) {
+        auto prefetch = std::make_shared<Prefetch>();
+        prefetch->depth = depth;
+        {
+            // count all assets up front, callbacks may finish before we're done submitting
+            std::lock_guard<std::mutex> lock(prefetch->mutex);
+            prefetch->pending = paths.size() + 1;
+        }
+        size_t fetched = 0;
+        for (const auto& path : paths) {
+            if (!prefetch_object(path, prefetch)) {
+                std::lock_guard<std::mutex> lock(prefetch->mutex);
+                --prefetch->pending;
+            }
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(prefetch->mutex);
+            --prefetch->pending;
+            prefetch->cond.wait(lock, [&prefetch] { return prefetch->pending == 0; });
+        }
+
+        // assets that were already cached or owned by another thread
+        for (const auto& path : paths) {
+            auto entry = get_cache_entry(path);
+            std::unique_lock<std::mutex> lock(entry->mutex);
+            wait_in_flight(*entry, lock);
+            if (entry->cache.state != CACHE_MISSING) {
+                ++fetched;
+            }
+        }
+        TF_DEBUG(S3_DBG).Msg("S3: prefetch done, %zu of %zu assets available (%zu downloaded)\n",
+            fetched, paths.size(), prefetch->fetched);
+        return fetched;
+    }
+
+    // Resolve and fetch a set of assets concurrently on the client's executor.
+    // Returns the number of assets that are available locally afterwards.
+    size_t S3::prefetch(const std::vector<std::string>& asset_paths) {
+        ensure_setup();
+        if (default_client == nullptr) {
+            TF_DEBUG(S3_DBG).Msg("S3: prefetch - abort due to missing client\n");
+            return 0;
+        }
+
+        std::vector<std::string> paths;
+        paths.reserve(asset_paths.size());
+        for (const auto& asset_path : asset_paths) {
+            if (!matches_schema(asset_path)) {
+                continue;
+            }
+            paths.push_back(make_path(asset_path));
+        }
+        TF_DEBUG(S3_DBG).Msg("S3: prefetch %zu assets\n", paths.size());
+        return prefetch_paths(paths, prefetch_depth);
+    }
+
+    // Binds the client of a resolver context on the thread running an async request
+    class ScopedClient {
+    public:
+        explicit ScopedClient(const std::shared_ptr<Client>& client) {
+            bound_clients.push_back(client);
+        }
+        ~ScopedClient() {
+            bound_clients.pop_back();
+        }
+
+        ScopedClient(const ScopedClient&) = delete;
+        ScopedClient& operator=(const ScopedClient&) = delete;
+    };
+
+    // Run a request on the load executor and fulfill promise with its result,
+    // or with cancelled_value if the request is cancelled before it starts
+    template <typename T>
+    std::future<T> run_async(Priority priority, const std::shared_ptr<CancelToken>& cancel, const T& cancelled_value,
+            std::function<T()>&& request) {
+        auto promise = std::make_shared<std::promise<T>>();
+        auto future = promise->get_future();
+        if (load_executor == nullptr) {
+            promise->set_value(cancelled_value);
+            return future;
+        }
+        const auto client = current_client();
+        const bool submitted = load_executor->submit(priority, [promise, cancel, cancelled_value, client, request]() {
+            if (cancel && cancel->is_cancelled()) {
+                promise->set_value(cancelled_value);
+                return;
+            }
+            ScopedClient scoped_client(client);
+            try {
+                promise->set_value(request());
+            } catch (...) {
+                promise->set_exception(std::current_exception());
+            }
+        });
+        if (!submitted) {
+            promise->set_value(cancelled_value);
+        }
+        return future;
+    }
+
+    std::future<std::string> S3::resolve_async(const std::string& asset_path, Priority priority,
+            const std::shared_ptr<CancelToken>& cancel) {
+        TF_DEBUG(S3_DBG).Msg("S3: resolve_async %s\n", asset_path.c_str());
+        ensure_setup();
+        return run_async<std::string>(priority, cancel, std::string(), [this, asset_path]() {
+            return resolve_name(asset_path);
+        });
+    }
+
+    std::future<bool> S3::fetch_async(const std::string& asset_path, const std::string& local_path,
+            Priority priority, const std::shared_ptr<CancelToken>& cancel) {
+        TF_DEBUG(S3_DBG).Msg("S3: fetch_async %s\n", asset_path.c_str());
+        ensure_setup();
+        return run_async<bool>(priority, cancel, false, [this, asset_path, local_path]() {
+            return fetch_asset(asset_path, local_path);
+        });
+    }
+
+    // Fetch a large layer in the background and serve a placeholder layer in the
+    // meantime. on_loaded is called on the load executor when the download is done.
+    // Returns false if the asset isn't loaded progressively, fetch it with fetch_asset then.
+    bool S3::fetch_progressive(const std::string& asset_path, const std::string& local_path,
+            const std::function<void(bool)>& on_loaded) {
+        ensure_setup();
+        if (progressive_threshold == 0 || default_client == nullptr || load_executor == nullptr) {
+            return false;
+        }
+        const auto path = find_path(asset_path, local_path);
+        if (!can_have_placeholder(get_object_name(path))) {
+            return false;
+        }
+        const auto entry = find_cache_entry(path);
+        if (!entry) {
+            return false;
+        }
+        Cache cache;
+        {
+            std::lock_guard<std::mutex> lock(entry->mutex);
+            cache = entry->cache;
+        }
+        // only first downloads, an outdated layer stays in use until its update is downloaded
+        double local_date_modified;
+        if (cache.state != CACHE_NEEDS_FETCHING || cache.size < progressive_threshold || is_lazy(path, cache) ||
+                is_local_current(local_path, cache.timestamp, local_date_modified)) {
+            return false;
+        }
+
+        {
+            tbb::concurrent_hash_map<std::string, std::string>::accessor accessor;
+            if (!placeholders.insert(accessor, path)) {
+                // already downloading, keep serving its placeholder
+                return true;
+            }
+            PlaceholderInfo info = {};
+            {
+                tbb::concurrent_hash_map<std::string, PlaceholderInfo>::const_accessor info_accessor;
+                if (placeholder_infos.find(info_accessor, path)) {
+                    info = info_accessor->second;
+                }
+            }
+            const std::string placeholder_path = local_path + ".placeholder." + TfGetExtension(local_path);
+            if (!make_local_dir(cache) || !write_placeholder(placeholder_path, info)) {
+                S3_WARN("[S3Resolver] failed to write placeholder %s", placeholder_path.c_str());
+                placeholders.erase(accessor);
+                return false;
+            }
+            accessor->second = placeholder_path;
+        }
+        TF_DEBUG(S3_DBG).Msg("S3: fetch_progressive %s, %zu bytes in the background\n", path.c_str(), cache.size);
+        add_metric(Counter::PROGRESSIVE_LOADS);
+
+        // the stage waits for this download, it goes before prefetches
+        run_async<bool>(Priority::FOREGROUND, nullptr, false, [this, path, asset_path, local_path, on_loaded]() {
+            const bool success = fetch_asset(asset_path, local_path);
+            std::string placeholder_path;
+            {
+                tbb::concurrent_hash_map<std::string, std::string>::accessor accessor;
+                if (placeholders.find(accessor, path)) {
+                    placeholder_path = accessor->second;
+                    placeholders.erase(accessor);
+                }
+            }
+            // open placeholder assets keep reading the removed file
+            std::remove(placeholder_path.c_str());
+            TF_DEBUG(S3_DBG).Msg("S3: fetch_progressive %s done, %s\n", path.c_str(), success ? "loaded" : "failed");
+            if (on_loaded) {
+                on_loaded(success);
+            }
+            return success;
+        });
+        return true;
+    }
+
+    // Open an object kept in memory, downloading it again if it was evicted since its fetch.
+    // Returns nullptr if the object is read from its local path after all.
+    std::shared_ptr<ArAsset> open_memory_asset(const std::string& path, const std::shared_ptr<CacheEntry>& entry,
+            const Cache& cache) {
+        MemoryCache::Buffer buffer;
+        size_t size = 0;
+        if (memory_cache.find(path, cache.etag, buffer, size)) {
+            add_metric(Counter::MEMORY_HITS);
+            return std::make_shared<S3MemoryAsset>(buffer, size);
+        }
+        double local_date_modified;
+        if (is_local_current(cache.local_path, cache.timestamp, local_date_modified)) {
+            // written through to the local cache
+            return nullptr;
+        }
+        TF_DEBUG(S3_DBG).Msg("S3: open_asset %s was evicted from memory\n", path.c_str());
+        add_metric(Counter::MEMORY_MISSES);
+        std::unique_lock<std::mutex> lock(entry->mutex);
+        if (!wait_in_flight(*entry, lock)) {
+            entry->in_flight = true;
+            Cache refetched = entry->cache;
+            lock.unlock();
+            refetched.is_in_memory = false;
+            if (!fetch_to_memory(path, refetched)) {
+                refetched.state = CACHE_NEEDS_FETCHING;
+            }
+            finish_in_flight(*entry, lock, refetched);
+        }
+        if (!memory_cache.find(path, entry->cache.etag, buffer, size)) {
+            return nullptr;
+        }
+        return std::make_shared<S3MemoryAsset>(buffer, size);
+    }
+
+    // Open a compressed file in the local cache, returns nullptr if the file isn't compressed.
+    // Only layers and objects stored with a Content-Encoding are checked, other objects
+    // such as textures are read as they are, even if they happen to be gzip files.
+    std::shared_ptr<ArAsset> open_compressed_asset(const std::string& path, const std::string& local_path,
+            const Cache& cache) {
+        if (!cache.is_compressed && !is_layer(path)) {
+            return nullptr;
+        }
+        FILE* file = ArchOpenFile(local_path.c_str(), "rb");
+        if (file == nullptr) {
+            return nullptr;
+        }
+        const Encoding encoding = detect_file_encoding(fileno(file));
+        if (encoding == Encoding::IDENTITY || !can_decode(encoding)) {
+            if (encoding != Encoding::IDENTITY) {
+                S3_WARN("[S3Resolver] can't decode %s, built without zstd", path.c_str());
+            }
+            fclose(file);
+            return nullptr;
+        }
+        TF_DEBUG(S3_DBG).Msg("S3: open_asset %s compressed\n", path.c_str());
+        return std::make_shared<S3CompressedAsset>(file, encoding, path);
+    }
+
+    // Open a resolved asset that is read with range requests, from memory, from its placeholder
+    // or from a compressed file. Returns nullptr for local paths that are read from the local cache
+    std::shared_ptr<ArAsset> S3::open_asset(const std::string& local_path) {
+        std::string path;
+        {
+            tbb::concurrent_hash_map<std::string, std::string>::const_accessor accessor;
+            if (!local_paths.find(accessor, local_path)) {
+                return nullptr;
+            }
+            path = accessor->second;
+        }
+        if (progressive_threshold > 0) {
+            tbb::concurrent_hash_map<std::string, std::string>::const_accessor accessor;
+            if (placeholders.find(accessor, path)) {
+                FILE* file = ArchOpenFile(accessor->second.c_str(), "rb");
+                return file ? std::make_shared<ArFilesystemAsset>(file) : nullptr;
+            }
+        }
+        const auto entry = find_cache_entry(path);
+        if (!entry) {
+            return nullptr;
+        }
+        Cache cache;
+        {
+            std::unique_lock<std::mutex> lock(entry->mutex);
+            wait_in_flight(*entry, lock);
+            cache = entry->cache;
+        }
+        if (cache.is_in_memory && cache.state == CACHE_FETCHED) {
+            if (auto asset = open_memory_asset(path, entry, cache)) {
+                return asset;
+            }
+        }
+        double local_date_modified;
+        if (is_lazy(path, cache) && !is_local_current(local_path, cache.timestamp, local_date_modified)) {
+            TF_DEBUG(S3_DBG).Msg("S3: open_asset %s lazily, %zu bytes\n", path.c_str(), cache.size);
+            return std::make_shared<S3RangeAsset>(*this, std::string(S3_PREFIX_SHORT) + path,
+                cache.size, lazy_block_size, lazy_cache_size);
+        }
+        return open_compressed_asset(path, local_path, cache);
+    }
+
+    // Keep a cached object from being evicted while its asset is open
+    std::shared_ptr<ArAsset> S3::pin_asset(const std::string& local_path, const std::shared_ptr<ArAsset>& asset) {
+        if (!asset || !cache_manager.is_enabled()) {
+            return asset;
+        }
+        std::string path;
+        {
+            tbb::concurrent_hash_map<std::string, std::string>::const_accessor accessor;
+            if (!local_paths.find(accessor, local_path)) {
+                return asset;
+            }
+            path = accessor->second;
+        }
+        cache_manager.pin(path);
+        return std::make_shared<S3PinnedAsset>(asset, [path]() {
+            cache_manager.unpin(path);
+        });
+    }
+
+    // Whether a Content-Range header covers the bytes requested from offset,
+    // a server that ignores the Range header answers with the whole object
+    bool is_requested_range(const Aws::String& content_range, size_t offset, size_t count, size_t written) {
+        unsigned long long first = 0;
+        unsigned long long last = 0;
+        if (sscanf(content_range.c_str(), "bytes %llu-%llu/", &first, &last) != 2) {
+            return false;
+        }
+        return first == offset && last >= first && last - first < count && last - first + 1 == written;
+    }
+
+    // Read a byte range of an asset into buffer, returns the number of bytes read
+    // The ranges are read from the version that was resolved: versioned paths
+    // name it, other paths must still have its ETag.
+    size_t S3::read_range(const std::string& asset_path, char* buffer, size_t offset, size_t count) {
+        ensure_setup();
+        if (default_client == nullptr || count == 0) {
+            return 0;
+        }
+        const auto path = parse_path(asset_path);
+        auto entry = find_cache_entry(path);
+        std::string etag;
+        if (entry) {
+            std::lock_guard<std::mutex> lock(entry->mutex);
+            etag = entry->cache.etag;
+        }
+        auto object_request = make_get_request(path);
+        object_request.SetRange(("bytes=" + std::to_string(offset) + "-" + std::to_string(offset + count - 1)).c_str());
+        if (!etag.empty()) {
+            object_request.SetIfMatch(etag.c_str());
+        }
+        RangeStreamBuf stream_buffer(buffer, count);
+        object_request.SetResponseStreamFactory([&stream_buffer]() {
+            stream_buffer.rewind();
+            return Aws::New<Aws::IOStream>("s3resolver", &stream_buffer);
+        });
+        auto outcome = get_object(*find_client(path)->s3, object_request, path);
+        if (!outcome.IsSuccess()) {
+            if (outcome.GetError().GetResponseCode() == Aws::Http::HttpResponseCode::PRECONDITION_FAILED && entry) {
+                // the object was replaced, the next resolve checks it again
+                S3_WARN("[S3Resolver] %s changed while it was read", path.c_str());
+                std::lock_guard<std::mutex> lock(entry->mutex);
+                if (!entry->in_flight && entry->cache.etag == etag) {
+                    entry->cache.state = CACHE_MISSING;
+                    entry->cache.retry_after = 0.0;
+                    entry->cache.failures = 0;
+                    entry->cache.is_fresh = false;
+                }
+            } else {
+                TF_DEBUG(S3_DBG).Msg("S3: read_range %s failed: %s %s\n", path.c_str(),
+                    outcome.GetError().GetExceptionName().c_str(), outcome.GetError().GetMessage().c_str());
+            }
+            return 0;
+        }
+        if (!is_requested_range(outcome.GetResult().GetContentRange(), offset, count, stream_buffer.written())) {
+            S3_WARN("[S3Resolver] %s: requested bytes %zu-%zu, got range '%s'", path.c_str(), offset,
+                offset + count - 1, outcome.GetResult().GetContentRange().c_str());
+            return 0;
+        }
+        return stream_buffer.written();
+    }
+
+    // Manifests by parsed path, see S3::open_manifest
+    tbb::concurrent_hash_map<std::string, std::shared_ptr<const Manifest>> manifests;
+
+    bool is_manifest(const std::string& path) {
+        const std::string object_name = get_object_name(path);
+        constexpr size_t suffix_length = cexpr_strlen(S3_SUFFIX);
+        return object_name.size() > suffix_length &&
+            object_name.compare(object_name.size() - suffix_length, suffix_length, S3_SUFFIX) == 0;
+    }
+
+    // Parsed path of an object listed in a manifest, relative to the directory of the manifest
+    // e.g. 'geo/chair.usdc' in 'bucket/assets/chair.s3' returns 'bucket/assets/geo/chair.usdc'
+    std::string get_manifest_object_path(const std::string& manifest_path, const std::string& object_path) {
+        const std::string object_name = get_object_name(manifest_path);
+        return get_endpoint_prefix(manifest_path) + get_bucket_name(manifest_path) + "/" +
+            object_name.substr(0, object_name.find_last_of('/') + 1) + object_path;
+    }
+
+    // Take the size and ETag of an object from its manifest, so it is downloaded
+    // without a HEAD request. Objects that are cached or in flight are left alone,
+    // unless the manifest lists another version than the one that is cached.
+    void seed_manifest_object(const std::string& path, const ManifestObject& object, double date_modified) {
+        auto entry = get_cache_entry(path);
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        if (entry->in_flight || entry->cache.is_pinned ||
+                (entry->cache.state == CACHE_FETCHED && entry->cache.etag == object.etag) ||
+                entry->cache.state == CACHE_NEEDS_FETCHING) {
+            return;
+        }
+        store_object_info(path, date_modified, object.size, object.etag, entry->cache);
+        add_metric(Counter::MANIFEST_OBJECTS);
+    }
+
+    // Read the content of a fetched object, from memory or its local path
+    bool read_object(const std::string& path, const Cache& cache, std::string& content) {
+        MemoryCache::Buffer buffer;
+        size_t size = 0;
+        if (cache.is_in_memory && memory_cache.find(path, cache.etag, buffer, size)) {
+            content.assign(buffer.get(), size);
+            return true;
+        }
+        std::ifstream file(cache.local_path.c_str(), std::ios::in | std::ios::binary);
+        if (!file) {
+            return false;
+        }
+        content.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        if (file.bad()) {
+            return false;
+        }
+        const Encoding encoding = detect_encoding(content.data(), content.size());
+        if (encoding == Encoding::IDENTITY) {
+            return true;
+        }
+        std::vector<char> decoded;
+        if (!decompress(encoding, content.data(), content.size(), decoded)) {
+            return false;
+        }
+        content.assign(decoded.data(), decoded.size());
+        return true;
+    }
+
+    std::shared_ptr<const Manifest> S3::open_manifest(const std::string& local_path) {
+        std::string path;
+        {
+            tbb::concurrent_hash_map<std::string, std::string>::const_accessor accessor;
+            if (!local_paths.find(accessor, local_path)) {
+                return nullptr;
+            }
+            path = accessor->second;
+        }
+        const auto entry = find_cache_entry(path);
+        if (!entry || !is_manifest(path)) {
+            return nullptr;
+        }
+        Cache cache;
+        {
+            std::unique_lock<std::mutex> lock(entry->mutex);
+            wait_in_flight(*entry, lock);
+            cache = entry->cache;
+        }
+        if (cache.state != CACHE_FETCHED || (cache.is_in_memory && !memory_cache.contains(path))) {
+            // USD resolves paths in a package without fetching the package first
+            fetch_asset(std::string(S3_PREFIX_SHORT) + path, local_path);
+            std::unique_lock<std::mutex> lock(entry->mutex);
+            wait_in_flight(*entry, lock);
+            cache = entry->cache;
+            if (cache.state != CACHE_FETCHED) {
+                return nullptr;
+            }
+        }
+
+        // opens of the same manifest wait here for the first one to download its objects
+        tbb::concurrent_hash_map<std::string, std::shared_ptr<const Manifest>>::accessor accessor;
+        manifests.insert(accessor, path);
+        if (accessor->second && accessor->second->etag == cache.etag) {
+            return accessor->second;
+        }
+        auto manifest = std::make_shared<Manifest>();
+        manifest->key = path;
+        manifest->etag = cache.etag;
+        manifest->last_modified = cache.timestamp;
+        std::string content;
+        std::string error;
+        if (!read_object(path, cache, content)) {
+            error = "can't read " + cache.local_path;
+        }
+        if (!error.empty() || !parse_manifest(content.data(), content.size(), *manifest, error)) {
+            S3_WARN("[S3Resolver] %s is not a valid manifest: %s", path.c_str(), error.c_str());
+            manifests.erase(accessor);
+            return nullptr;
+        }
+
+        // one concurrent download of everything the asset needs
+        std::vector<std::string> paths;
+        paths.reserve(manifest->objects.size());
+        for (const auto& object : manifest->objects) {
+            paths.push_back(get_manifest_object_path(path, object.path));
+            seed_manifest_object(paths.back(), object, manifest->last_modified);
+        }
+        TF_DEBUG(S3_DBG).Msg("S3: open_manifest %s, fetching %zu objects\n", path.c_str(), paths.size());
+        if (default_client != nullptr) {
+            // the manifest lists all dependencies, there is nothing to scan for
+            prefetch_paths(paths, 0);
+        }
+        accessor->second = manifest;
+        return manifest;
+    }
+
+    std::string S3::fetch_manifest_object(const Manifest& manifest, const ManifestObject& object) {
+        const std::string path = get_manifest_object_path(manifest.key, object.path);
+        // the batched download may have missed it, e.g. when the manifest was opened without a client
+        seed_manifest_object(path, object, manifest.last_modified);
+        auto entry = get_cache_entry(path);
+        std::string local_path;
+        {
+            std::unique_lock<std::mutex> lock(entry->mutex);
+            wait_in_flight(*entry, lock);
+            if (entry->cache.state != CACHE_MISSING) {
+                local_path = entry->cache.local_path;
+            }
+        }
+        if (local_path.empty() || !fetch_asset(std::string(S3_PREFIX_SHORT) + path, local_path)) {
+            return std::string();
+        }
+        return local_path;
+    }
+
+    RevalidationStats S3::get_revalidation_stats() const {
+        const Metrics metrics = get_metrics();
+        return RevalidationStats{metrics.get(Counter::REVALIDATIONS_AVOIDED),
+            metrics.get(Counter::REVALIDATIONS_NOT_MODIFIED), metrics.get(Counter::REVALIDATIONS_CHANGED)};
+    }
+
+    CacheStats S3::get_cache_stats() const {
+        const Metrics metrics = get_metrics();
+        return CacheStats{metrics.get(Counter::CACHE_HITS), metrics.get(Counter::CACHE_MISSES),
+            metrics.get(Counter::DEDUPLICATED_FETCHES), metrics.get(Counter::ADOPTED_FETCHES),
+            metrics.get(Counter::NEGATIVE_HITS),
+            cache_manager.get_evictions(),
+            cache_manager.get_size(), cache_manager.get_budget()};
+    }
+
+    MemoryCacheStats S3::get_memory_cache_stats() const {
+        const Metrics metrics = get_metrics();
+        return MemoryCacheStats{metrics.get(Counter::MEMORY_HITS), metrics.get(Counter::MEMORY_MISSES),
+            metrics.get(Counter::MEMORY_EVICTIONS), memory_cache.get_size(), memory_cache.get_budget()};
+    }
+
+    // Check if a local path belongs to an object kept in memory instead of on disk
+    bool S3::is_in_memory(const std::string& local_path) {
+        if (!memory_cache.is_enabled()) {
+            return false;
+        }
+        tbb::concurrent_hash_map<std::string, std::string>::const_accessor accessor;
+        return local_paths.find(accessor, local_path) && memory_cache.contains(accessor->second);
+    }
+
+    PrefetchStats S3::get_prefetch_stats() const {
+        const Metrics metrics = get_metrics();
+        return PrefetchStats{metrics.get(Counter::SCANNED_LAYERS), metrics.get(Counter::SPECULATIVE_FETCHES),
+            metrics.get(Counter::SPECULATIVE_HITS)};
+    }
+
+    // returns true if the path matches the S3 schema
+    bool S3::matches_schema(const std::string& path) {
+        constexpr auto schema_length_short = cexpr_strlen(usd_s3::S3_PREFIX_SHORT);
+        return path.compare(0, schema_length_short, usd_s3::S3_PREFIX_SHORT) == 0;
+    }
+
+    double S3::get_timestamp(const std::string& asset_path, const std::string& local_path) {
+        ensure_setup();
+        const std::string& path = find_path_key(asset_path, local_path);
+        if (default_client == nullptr) {
+            return 1.0;
+        }
+
+        const auto entry = find_cache_entry(path);
+        if (entry) {
+            std::lock_guard<std::mutex> lock(entry->mutex);
+            if (entry->cache.state != CACHE_MISSING) {
+                return entry->cache.timestamp;
+            }
         }
+        S3_WARN("[S3Resolver] %s is missing when querying timestamps!",
+                path.c_str());
+        return 1.0;
     }
 
 }
@@ -1,16 +1,25 @@
 #ifndef S3_H
 #define S3_H
 
+#include <pxr/pxr.h>
+#include <pxr/usd/ar/asset.h>
+
 #include <aws/core/Aws.h>
 #include <aws/s3/S3Client.h>
 #include <aws/s3/model/GetObjectRequest.h>
 #include <fstream>
 
+#include <functional>
+#include <future>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <vector>
 #include <map>
 
+#include "asyncRequest.h"
+#include "manifest.h"
+
 namespace usd_s3 {
     constexpr const char S3_PREFIX[] = "s3://";
     constexpr const char S3_PREFIX_SHORT[] = "s3:";
@@ -18,17 +27,129 @@ namespace usd_s3 {
     constexpr const char CACHE_PATH_ENV_VAR[] = "USD_S3_CACHE_PATH";
     constexpr const char PROXY_HOST_ENV_VAR[] = "USD_S3_PROXY_HOST";
     constexpr const char PROXY_PORT_ENV_VAR[] = "USD_S3_PROXY_PORT";
+    constexpr const char ENDPOINT_ENV_VAR[] = "USD_S3_ENDPOINT";
+    constexpr const char REGION_ENV_VAR[] = "USD_S3_REGION";
+    constexpr const char CONNECT_TIMEOUT_ENV_VAR[] = "USD_S3_CONNECT_TIMEOUT";
+    constexpr const char REQUEST_TIMEOUT_ENV_VAR[] = "USD_S3_REQUEST_TIMEOUT";
+    constexpr const char MAX_CONNECTIONS_ENV_VAR[] = "USD_S3_MAX_CONNECTIONS";
+    constexpr const char BANDWIDTH_LIMIT_ENV_VAR[] = "USD_S3_BANDWIDTH_LIMIT";
+    constexpr const char CACHE_SIZE_ENV_VAR[] = "USD_S3_CACHE_SIZE";
+    constexpr const char LIST_PREFIXES_ENV_VAR[] = "USD_S3_LIST_PREFIXES";
+    constexpr const char NEGATIVE_TTL_ENV_VAR[] = "USD_S3_NEGATIVE_TTL";
+    constexpr const char TTL_ENV_VAR[] = "USD_S3_TTL";
+    constexpr const char TTL_RULES_ENV_VAR[] = "USD_S3_TTL_RULES";
+    constexpr const char MULTIPART_THRESHOLD_ENV_VAR[] = "USD_S3_MULTIPART_THRESHOLD";
+    constexpr const char MULTIPART_PART_SIZE_ENV_VAR[] = "USD_S3_MULTIPART_PART_SIZE";
+    constexpr const char MULTIPART_THREADS_ENV_VAR[] = "USD_S3_MULTIPART_THREADS";
+    constexpr const char LAZY_THRESHOLD_ENV_VAR[] = "USD_S3_LAZY_THRESHOLD";
+    constexpr const char LAZY_BLOCK_SIZE_ENV_VAR[] = "USD_S3_LAZY_BLOCK_SIZE";
+    constexpr const char LAZY_CACHE_SIZE_ENV_VAR[] = "USD_S3_LAZY_CACHE_SIZE";
+    constexpr const char PROGRESSIVE_THRESHOLD_ENV_VAR[] = "USD_S3_PROGRESSIVE_THRESHOLD";
+    constexpr const char PREFETCH_THREADS_ENV_VAR[] = "USD_S3_PREFETCH_THREADS";
+    constexpr const char PREFETCH_DEPTH_ENV_VAR[] = "USD_S3_PREFETCH_DEPTH";
+    constexpr const char PREFETCH_SCAN_THREADS_ENV_VAR[] = "USD_S3_PREFETCH_SCAN_THREADS";
+    constexpr const char TRACE_PATH_ENV_VAR[] = "USD_S3_TRACE_PATH";
+    constexpr const char MAX_ATTEMPTS_ENV_VAR[] = "USD_S3_MAX_ATTEMPTS";
+    constexpr const char RETRY_DELAY_ENV_VAR[] = "USD_S3_RETRY_DELAY";
+    constexpr const char RETRY_MAX_DELAY_ENV_VAR[] = "USD_S3_RETRY_MAX_DELAY";
+    constexpr const char REQUEST_DEADLINE_ENV_VAR[] = "USD_S3_REQUEST_DEADLINE";
+    constexpr const char HEDGE_QUANTILE_ENV_VAR[] = "USD_S3_HEDGE_QUANTILE";
+    constexpr const char MEMORY_CACHE_SIZE_ENV_VAR[] = "USD_S3_MEMORY_CACHE_SIZE";
+    constexpr const char MEMORY_THRESHOLD_ENV_VAR[] = "USD_S3_MEMORY_THRESHOLD";
+    constexpr const char MEMORY_WRITE_THROUGH_ENV_VAR[] = "USD_S3_MEMORY_WRITE_THROUGH";
+    constexpr const char CACHE_COMPRESSION_ENV_VAR[] = "USD_S3_CACHE_COMPRESSION";
+
+    // Settings of an S3 client, empty or zero settings fall back to the
+    // environment variables
+    struct ClientConfig {
+        std::string endpoint;           // [scheme://]host[:port]
+        std::string region;
+        std::string profile;            // credentials profile in ~/.aws/credentials
+        std::string cache_path;         // directory of the cached objects
+        long connect_timeout_ms;
+        long request_timeout_ms;
+        unsigned max_connections;       // keep-alive connections to the endpoint
+    };
+
+    // Identity of a client config, configs with the same key share a client
+    std::string get_config_key(const ClientConfig& config);
+
+    // Counters of the local cache
+    struct CacheStats {
+        size_t hits;            // fetches served from the local cache
+        size_t misses;          // objects downloaded
+        size_t deduplicated;    // objects linked to a blob with the same content instead of downloading them
+        size_t shared;          // objects downloaded by another process sharing the cache path
+        size_t negative_hits;   // resolves of missing objects answered without a request
+        size_t evictions;
+        size_t size;            // bytes in the local cache
+        size_t budget;          // 0 if the cache is unbounded
+    };
+
+    // Counters of the memory cache of small objects
+    struct MemoryCacheStats {
+        size_t hits;            // opens served from memory
+        size_t misses;          // opens of objects that were evicted from memory after their fetch
+        size_t evictions;
+        size_t size;            // bytes in memory
+        size_t budget;          // 0 if the memory cache is disabled
+    };
+
+    // Counters of the freshness checks of fetched objects
+    struct RevalidationStats {
+        size_t avoided;         // fetches served within the TTL without a request
+        size_t not_modified;    // revalidations that found the object unchanged
+        size_t changed;         // revalidations that downloaded a new version
+    };
+
+    // Counters of the dependency prefetch
+    struct PrefetchStats {
+        size_t scanned;     // layers scanned for s3 dependencies
+        size_t fetched;     // assets downloaded speculatively
+        size_t used;        // speculative downloads that USD fetched afterwards
+    };
 
     class S3 {
     public:
+        // The SDK and the clients are set up by the first call that needs them
         S3();
         ~S3();
 
+        void bind_config(const ClientConfig& config);
+        void unbind_config();
+
         std::string resolve_name(const std::string& path);
         bool fetch_asset(const std::string& asset_path, const std::string& local_path);
+        size_t prefetch(const std::vector<std::string>& asset_paths);
+
+        // resolve_name and fetch_asset on the load executor, in the resolver
+        // context that is bound when they are called
+        std::future<std::string> resolve_async(const std::string& asset_path,
+            Priority priority = Priority::FOREGROUND, const std::shared_ptr<CancelToken>& cancel = nullptr);
+        std::future<bool> fetch_async(const std::string& asset_path, const std::string& local_path,
+            Priority priority = Priority::FOREGROUND, const std::shared_ptr<CancelToken>& cancel = nullptr);
+        bool fetch_progressive(const std::string& asset_path, const std::string& local_path,
+            const std::function<void(bool)>& on_loaded);
+        PrefetchStats get_prefetch_stats() const;
+        RevalidationStats get_revalidation_stats() const;
+        CacheStats get_cache_stats() const;
+        MemoryCacheStats get_memory_cache_stats() const;
+
+        std::shared_ptr<PXR_NS::ArAsset> open_asset(const std::string& local_path);
+        std::shared_ptr<PXR_NS::ArAsset> pin_asset(const std::string& local_path,
+            const std::shared_ptr<PXR_NS::ArAsset>& asset);
+        size_t read_range(const std::string& asset_path, char* buffer, size_t offset, size_t count);
+        bool is_in_memory(const std::string& local_path);
+
+        // .s3 manifests, see manifest.h
+        // The manifest fetched to a local path, the first open downloads all
+        // its objects concurrently. Returns nullptr if it isn't a manifest.
+        std::shared_ptr<const Manifest> open_manifest(const std::string& local_path);
+        // Local path of an object of a manifest, fetched if it isn't yet
+        std::string fetch_manifest_object(const Manifest& manifest, const ManifestObject& object);
 
         bool matches_schema(const std::string& path);
-        double get_timestamp(const std::string& asset_path);
+        double get_timestamp(const std::string& asset_path, const std::string& local_path);
         bool check_time(const std::string& path, double time);
 
         private:
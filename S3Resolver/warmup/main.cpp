@@ -0,0 +1,261 @@
+// Pre-stages the S3 dependencies of root layers in the local cache of the S3Resolver.
+//
+// Farm nodes run it once per job, so no process of the job waits for S3 on a
+// cold cache. The resolver is loaded as a plugin like in any other USD
+// application, PXR_PLUGINPATH_NAME must include the directory of its
+// plugInfo.json. The objects and the cache index are written to
+// USD_S3_CACHE_PATH, other USD_S3_* variables are passed on to the resolver.
+
+#include <pxr/base/tf/pathUtils.h>
+#include <pxr/base/tf/stringUtils.h>
+#include <pxr/usd/ar/packageUtils.h>
+#include <pxr/usd/ar/resolver.h>
+#include <pxr/usd/sdf/layer.h>
+#include <pxr/usd/sdf/layerUtils.h>
+#include <pxr/usd/usdUtils/dependencies.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <sys/stat.h>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    constexpr const char S3_PREFIX[] = "s3:";
+
+    struct Options {
+        std::vector<std::string> roots;
+        int jobs;
+        double bandwidth_mbps;      // 0 is unlimited
+        bool follow;                // follow the dependencies of the roots
+    };
+
+    struct Totals {
+        std::atomic<size_t> objects;
+        std::atomic<size_t> downloaded;
+        std::atomic<size_t> bytes;              // size of all staged objects in the local cache
+        std::atomic<size_t> bytes_downloaded;
+        std::atomic<size_t> missing;
+        std::atomic<size_t> failed;
+    };
+
+    void print_usage(const char* program) {
+        fprintf(stderr, "usage: %s [options] s3-path...\n"
+            "  --jobs N               objects fetched concurrently, default 16\n"
+            "  --bandwidth-mbps N     download bandwidth of all jobs together, 0 is unlimited, default 0\n"
+            "  --no-follow            only fetch the given paths, not their dependencies\n"
+            "Set USD_S3_CACHE_PATH to the cache of the job, PXR_PLUGINPATH_NAME must include the S3Resolver.\n",
+            program);
+    }
+
+    bool parse_options(int argc, char** argv, Options& options) {
+        options = Options{{}, 16, 0.0, true};
+        for (int i = 1; i < argc; ++i) {
+            const std::string option = argv[i];
+            if (option == "--no-follow") {
+                options.follow = false;
+                continue;
+            }
+            if (option.compare(0, 2, "--") != 0) {
+                options.roots.push_back(option);
+                continue;
+            }
+            if (i + 1 >= argc) {
+                return false;
+            }
+            const std::string value = argv[++i];
+            if (option == "--jobs") {
+                options.jobs = std::max(1, atoi(value.c_str()));
+            } else if (option == "--bandwidth-mbps") {
+                options.bandwidth_mbps = std::max(0.0, std::atof(value.c_str()));
+            } else {
+                return false;
+            }
+        }
+        return !options.roots.empty();
+    }
+
+    bool is_s3_path(const std::string& path) {
+        return path.compare(0, sizeof(S3_PREFIX) - 1, S3_PREFIX) == 0;
+    }
+
+    bool is_layer(const std::string& path) {
+        const std::string extension = TfGetExtension(path);
+        return extension == "usd" || extension == "usda" || extension == "usdc" || extension == "usdz" ||
+            extension == "s3";
+    }
+
+    // Fetches the paths in its queue on a number of threads, and queues the
+    // s3 dependencies of the layers it fetched. Every path is fetched once.
+    class Walker {
+    public:
+        Walker(ArResolver& resolver, bool follow, Totals& totals)
+            : resolver(resolver), follow(follow), totals(totals), busy(0) {
+        }
+
+        void add(const std::string& path) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (visited.insert(path).second) {
+                queue.push_back(path);
+                cond.notify_one();
+            }
+        }
+
+        void run(int jobs) {
+            std::vector<std::thread> threads;
+            for (int i = 0; i < jobs; ++i) {
+                threads.emplace_back([this]() {
+                    work();
+                });
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+        }
+
+    private:
+        void work() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                cond.wait(lock, [this]() {
+                    return !queue.empty() || busy == 0;
+                });
+                if (queue.empty()) {
+                    // nothing queued and nothing running that could queue more
+                    return;
+                }
+                const std::string path = queue.front();
+                queue.pop_front();
+                ++busy;
+                lock.unlock();
+                stage(path);
+                lock.lock();
+                --busy;
+                cond.notify_all();
+            }
+        }
+
+        // Fetch an object to the local cache and queue its dependencies
+        void stage(const std::string& path) {
+            const std::string local_path = resolver.Resolve(path);
+            if (local_path.empty()) {
+                fprintf(stderr, "missing %s\n", path.c_str());
+                ++totals.missing;
+                return;
+            }
+            // a new download is published as a new file at the local path
+            struct stat before, after;
+            const bool was_cached = stat(local_path.c_str(), &before) == 0;
+            if (!resolver.FetchToLocalResolvedPath(path, local_path) || stat(local_path.c_str(), &after) != 0) {
+                fprintf(stderr, "failed to fetch %s\n", path.c_str());
+                ++totals.failed;
+                return;
+            }
+            ++totals.objects;
+            totals.bytes += static_cast<size_t>(after.st_size);
+            if (!was_cached || before.st_ino != after.st_ino || before.st_mtime != after.st_mtime) {
+                ++totals.downloaded;
+                totals.bytes_downloaded += static_cast<size_t>(after.st_size);
+            }
+            if (follow && is_layer(path)) {
+                add_dependencies(path);
+            }
+        }
+
+        // Queue the s3 sublayers, references, payloads and asset values of a layer,
+        // of all variants. Paths inside packages and manifests come with the package.
+        void add_dependencies(const std::string& path) {
+            const SdfLayerRefPtr layer = SdfLayer::FindOrOpen(path);
+            if (!layer) {
+                fprintf(stderr, "failed to open %s\n", path.c_str());
+                ++totals.failed;
+                return;
+            }
+            std::vector<std::string> sublayers, references, payloads;
+            UsdUtilsExtractExternalReferences(layer->GetIdentifier(), &sublayers, &references, &payloads);
+            for (const auto* asset_paths : {&sublayers, &references, &payloads}) {
+                for (const auto& asset_path : *asset_paths) {
+                    const std::string anchored = SdfComputeAssetPathRelativeToLayer(layer, asset_path);
+                    if (is_s3_path(anchored) && !ArIsPackageRelativePath(anchored)) {
+                        add(anchored);
+                    }
+                }
+            }
+        }
+
+        ArResolver& resolver;
+        const bool follow;
+        Totals& totals;
+
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::deque<std::string> queue;
+        std::unordered_set<std::string> visited;
+        int busy;
+    };
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    for (const auto& root : options.roots) {
+        if (!is_s3_path(root)) {
+            fprintf(stderr, "%s is not an s3 path\n", root.c_str());
+            return 2;
+        }
+    }
+
+    // the resolver reads its settings on the first s3 path it sees.
+    // Everything is downloaded to the local cache: objects kept in memory, read
+    // with range requests or loaded progressively would be gone with this process.
+    setenv("USD_S3_MEMORY_CACHE_SIZE", "0", 1);
+    setenv("USD_S3_LAZY_THRESHOLD", "0", 1);
+    setenv("USD_S3_PROGRESSIVE_THRESHOLD", "0", 1);
+    // the dependencies are walked here, not by the prefetch of the resolver
+    setenv("USD_S3_PREFETCH_DEPTH", "0", 1);
+    setenv("USD_S3_MAX_CONNECTIONS", std::to_string(options.jobs).c_str(), 0);
+    if (options.bandwidth_mbps > 0.0) {
+        setenv("USD_S3_BANDWIDTH_LIMIT",
+            std::to_string(static_cast<unsigned long long>(options.bandwidth_mbps * 1e6 / 8.0)).c_str(), 1);
+    }
+    ArSetPreferredResolver("S3Resolver");
+    ArResolver& resolver = ArGetResolver();
+    // the default resolver takes s3 paths for relative paths
+    if (resolver.IsRelativePath(options.roots.front())) {
+        fprintf(stderr, "%s is not an S3Resolver path, is the S3Resolver in PXR_PLUGINPATH_NAME?\n",
+            options.roots.front().c_str());
+        return 1;
+    }
+
+    Totals totals{{0}, {0}, {0}, {0}, {0}, {0}};
+    Walker walker(resolver, options.follow, totals);
+    for (const auto& root : options.roots) {
+        walker.add(root);
+    }
+    const auto start = Clock::now();
+    walker.run(options.jobs);
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    printf("objects: %zu\ndownloaded: %zu\nbytes: %zu\nbytes_downloaded: %zu\nmissing: %zu\nfailed: %zu\n"
+        "seconds: %.3f\nthroughput_mbps: %.1f\n",
+        totals.objects.load(), totals.downloaded.load(), totals.bytes.load(), totals.bytes_downloaded.load(),
+        totals.missing.load(), totals.failed.load(), seconds,
+        seconds > 0.0 ? static_cast<double>(totals.bytes_downloaded.load()) * 8.0 / 1e6 / seconds : 0.0);
+    return totals.missing.load() > 0 || totals.failed.load() > 0 ? 1 : 0;
+}
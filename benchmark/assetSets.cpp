@@ -0,0 +1,156 @@
+#include "assetSets.h"
+#include "mockS3.h"
+
+#include <pxr/base/gf/vec3f.h>
+#include <pxr/base/tf/stringUtils.h>
+#include <pxr/base/tf/token.h>
+#include <pxr/base/vt/array.h>
+#include <pxr/usd/sdf/layer.h>
+#include <pxr/usd/sdf/path.h>
+#include <pxr/usd/sdf/types.h>
+#include <pxr/usd/usd/attribute.h>
+#include <pxr/usd/usd/prim.h>
+#include <pxr/usd/usd/stage.h>
+#include <pxr/usd/usd/zipFile.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+namespace {
+    // Attributes per small layer, about 2 KiB of text
+    constexpr size_t SMALL_LAYER_ATTRIBUTES = 32;
+
+    std::string get_s3_path(const std::string& bucket, const std::string& key) {
+        return "s3://" + bucket + "/" + key;
+    }
+
+    // The layers carry their own path, so layers of different runs differ and
+    // the content-addressed cache downloads each of them
+    std::string make_layer_header(const std::string& s3_path, const std::string& metadata) {
+        return "#usda 1.0\n(\n    doc = \"" + s3_path + "\"\n" + metadata + ")\n\n";
+    }
+
+    std::string make_attributes(size_t seed) {
+        std::string attributes;
+        for (size_t i = 0; i < SMALL_LAYER_ATTRIBUTES; ++i) {
+            attributes += TfStringPrintf("    double attribute_%zu = %zu\n", i, seed * SMALL_LAYER_ATTRIBUTES + i);
+        }
+        return attributes;
+    }
+
+    void put(usd_s3_benchmark::MockS3& server, usd_s3_benchmark::AssetSet& asset_set, const std::string& bucket,
+            const std::string& key, const std::string& content) {
+        server.put_object(bucket, key, content);
+        asset_set.assets.push_back(get_s3_path(bucket, key));
+        asset_set.bytes += content.size();
+    }
+
+    bool read_file(const std::string& path, std::string& content) {
+        std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+        if (!file) {
+            return false;
+        }
+        content.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        return true;
+    }
+
+    // Write a crate file of about size bytes of point data, seed makes the content unique
+    bool write_crate(const std::string& path, size_t size, uint64_t seed) {
+        UsdStageRefPtr stage = UsdStage::CreateNew(path);
+        if (!stage) {
+            return false;
+        }
+        UsdPrim prim = stage->DefinePrim(SdfPath("/Model"), TfToken("Mesh"));
+        stage->SetDefaultPrim(prim);
+        VtVec3fArray points(size / sizeof(GfVec3f));
+        // xorshift, random floats don't compress
+        uint64_t state = seed * 2654435761ULL + 1;
+        for (auto& point : points) {
+            float values[3];
+            for (float& value : values) {
+                state ^= state << 13;
+                state ^= state >> 7;
+                state ^= state << 17;
+                value = static_cast<float>(state % 100000) * 0.01f;
+            }
+            point = GfVec3f(values[0], values[1], values[2]);
+        }
+        prim.CreateAttribute(TfToken("points"), SdfValueTypeNames->Point3fArray).Set(points);
+        return stage->GetRootLayer()->Save();
+    }
+}
+
+namespace usd_s3_benchmark {
+    AssetSet make_small_layers(MockS3& server, const std::string& bucket, const std::string& prefix, size_t count) {
+        AssetSet asset_set{"small_layers", get_s3_path(bucket, prefix + "small/root.usda"), {}, 0};
+        std::string sublayers;
+        std::vector<std::pair<std::string, std::string>> layers;
+        for (size_t i = 0; i < count; ++i) {
+            const std::string key = TfStringPrintf("%ssmall/layer_%zu.usda", prefix.c_str(), i);
+            sublayers += "        @" + get_s3_path(bucket, key) + "@,\n";
+            layers.emplace_back(key, make_layer_header(get_s3_path(bucket, key), "") +
+                TfStringPrintf("over \"World\"\n{\n    def Xform \"Layer_%zu\"\n    {\n", i) +
+                make_attributes(i) + "    }\n}\n");
+        }
+        put(server, asset_set, bucket, prefix + "small/root.usda",
+            make_layer_header(asset_set.root, "    subLayers = [\n" + sublayers + "    ]\n") + "def Xform \"World\"\n{\n}\n");
+        for (const auto& layer : layers) {
+            put(server, asset_set, bucket, layer.first, layer.second);
+        }
+        return asset_set;
+    }
+
+    AssetSet make_reference_chain(MockS3& server, const std::string& bucket, const std::string& prefix, size_t depth) {
+        AssetSet asset_set{"reference_chain", get_s3_path(bucket, prefix + "chain/chain_0.usda"), {}, 0};
+        for (size_t i = 0; i < depth; ++i) {
+            const std::string key = TfStringPrintf("%schain/chain_%zu.usda", prefix.c_str(), i);
+            const std::string references = i + 1 < depth ?
+                TfStringPrintf("    prepend references = @%s@\n",
+                    get_s3_path(bucket, TfStringPrintf("%schain/chain_%zu.usda", prefix.c_str(), i + 1)).c_str()) :
+                std::string();
+            put(server, asset_set, bucket, key, make_layer_header(get_s3_path(bucket, key), "    defaultPrim = \"Chain\"\n") +
+                "def Xform \"Chain\" (\n" + references + ")\n{\n" +
+                TfStringPrintf("    def Xform \"Level_%zu\"\n    {\n", i) + make_attributes(i) + "    }\n}\n");
+        }
+        return asset_set;
+    }
+
+    AssetSet make_large_packages(MockS3& server, const std::string& bucket, const std::string& prefix, size_t count,
+            size_t size, const std::string& work_dir) {
+        static uint64_t package_count = 0;
+        AssetSet asset_set{"large_packages", get_s3_path(bucket, prefix + "large/root.usda"), {}, 0};
+        std::string references;
+        std::vector<std::pair<std::string, std::string>> packages;
+        for (size_t i = 0; i < count; ++i) {
+            const std::string key = TfStringPrintf("%slarge/model_%zu.usdz", prefix.c_str(), i);
+            // the layer registry would hand back an earlier crate file with the same path
+            const uint64_t seed = ++package_count;
+            const std::string crate_path = TfStringPrintf("%s/model_%llu.usdc", work_dir.c_str(),
+                static_cast<unsigned long long>(seed));
+            const std::string package_path = work_dir + "/model.usdz";
+            std::string content;
+            {
+                UsdZipFileWriter writer = UsdZipFileWriter::CreateNew(package_path);
+                if (!write_crate(crate_path, size, seed) || writer.AddFile(crate_path, "model.usdc").empty() ||
+                        !writer.Save() || !read_file(package_path, content)) {
+                    fprintf(stderr, "failed to build %s\n", package_path.c_str());
+                    continue;
+                }
+            }
+            std::remove(crate_path.c_str());
+            std::remove(package_path.c_str());
+            references += TfStringPrintf("def \"Model_%zu\" (\n    prepend references = @%s@\n)\n{\n}\n\n",
+                i, get_s3_path(bucket, key).c_str());
+            packages.emplace_back(key, content);
+        }
+        put(server, asset_set, bucket, prefix + "large/root.usda", make_layer_header(asset_set.root, "") + references);
+        for (const auto& package : packages) {
+            put(server, asset_set, bucket, package.first, package.second);
+        }
+        return asset_set;
+    }
+}
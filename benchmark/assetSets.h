@@ -0,0 +1,32 @@
+#ifndef S3_BENCHMARK_ASSET_SETS_H
+#define S3_BENCHMARK_ASSET_SETS_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace usd_s3_benchmark {
+    class MockS3;
+
+    // A synthetic set of assets uploaded to the mock server
+    struct AssetSet {
+        std::string name;
+        std::string root;                   // s3 path of the layer that pulls in all others
+        std::vector<std::string> assets;    // s3 paths of all objects, the root first
+        size_t bytes;
+    };
+
+    // A root layer with count small sublayers
+    AssetSet make_small_layers(MockS3& server, const std::string& bucket, const std::string& prefix, size_t count);
+
+    // A chain of depth layers, each one referencing the next
+    AssetSet make_reference_chain(MockS3& server, const std::string& bucket, const std::string& prefix, size_t depth);
+
+    // A root layer referencing count usdz packages of about size bytes each.
+    // The packages are built in work_dir, each with different content so the
+    // content-addressed cache can't share them.
+    AssetSet make_large_packages(MockS3& server, const std::string& bucket, const std::string& prefix, size_t count,
+        size_t size, const std::string& work_dir);
+}
+
+#endif // S3_BENCHMARK_ASSET_SETS_H
@@ -0,0 +1,675 @@
+// Benchmarks the S3Resolver against an in-process S3 stand-in.
+//
+// The resolver is loaded as a plugin, PXR_PLUGINPATH_NAME must include the
+// directory of its plugInfo.json. Results are written as JSON, see README.md.
+
+#include "assetSets.h"
+#include "cacheIndex.h"
+#include "mockS3.h"
+
+#include <pxr/base/arch/systemInfo.h>
+#include <pxr/base/tf/fileUtils.h>
+#include <pxr/base/tf/stringUtils.h>
+#include <pxr/usd/ar/resolver.h>
+#include <pxr/usd/usd/stage.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <ftw.h>
+#include <iostream>
+#include <spawn.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    constexpr const char BUCKET[] = "benchmark";
+    constexpr size_t RESOLVE_LATENCY_ITERATIONS = 1000000;
+    constexpr const char STARTUP_PROBE_OPTION[] = "--startup-probe";
+    constexpr const char FETCH_PROBE_OPTION[] = "--fetch-probe";
+    constexpr const char PLUGIN_PATH_VARIABLE[] = "PXR_PLUGINPATH_NAME=";
+
+    struct Options {
+        usd_s3_benchmark::NetworkProfile profile;
+        size_t small_layers;
+        size_t chain_depth;
+        size_t large_packages;
+        size_t large_package_size;
+        std::vector<int> thread_counts;
+        std::vector<int> process_counts;
+        std::vector<size_t> part_sizes;
+        std::vector<int> part_thread_counts;
+        double resolve_seconds;
+        int repeat;
+        bool compress;
+        int startup_runs;
+        size_t index_records;
+        std::string output;
+        std::string startup_probe;  // local layer to open in a startup probe process
+        std::string fetch_probe;    // s3 paths separated by ';' to fetch in a fetch probe process
+    };
+
+    struct Result {
+        std::string name;
+        std::string asset_set;
+        int threads;
+        double value;
+        const char* unit;
+    };
+
+    double seconds_since(Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    // Peak resident set size of the process so far
+    long get_peak_rss_kb() {
+        struct rusage usage;
+        return getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+    }
+
+    // CPU time of all threads of the process so far, user and system
+    double get_cpu_seconds() {
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0) {
+            return 0.0;
+        }
+        return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+            static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+    }
+
+    size_t directory_bytes = 0;
+
+    int add_file_bytes(const char*, const struct stat* file_stat, int type, struct FTW*) {
+        if (type == FTW_F) {
+            directory_bytes += static_cast<size_t>(file_stat->st_blocks) * 512;
+        }
+        return 0;
+    }
+
+    // Disk space taken by the files under a directory, hard links are counted once
+    size_t get_directory_bytes(const std::string& path) {
+        directory_bytes = 0;
+        nftw(path.c_str(), add_file_bytes, 16, FTW_PHYS);
+        return directory_bytes;
+    }
+
+    void print_usage(const char* program) {
+        fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --latency-ms N         latency of every response, default 20\n"
+            "  --bandwidth-mbps N     bandwidth per connection, 0 is unlimited, default 1000\n"
+            "  --slow-fraction N      fraction of responses with the slow latency, default 0\n"
+            "  --slow-latency-ms N    latency of the slow responses, default 500\n"
+            "  --small-layers N       sublayers of the small layer set, default 200\n"
+            "  --chain-depth N        layers in the reference chain, default 50\n"
+            "  --large-packages N     usdz packages in the large set, default 4\n"
+            "  --large-size-mb N      size of each usdz package, default 32\n"
+            "  --threads N,N,...      thread counts of the resolve benchmark, default 1,2,4,8,16\n"
+            "  --processes N,N,...    processes fetching the small layers into one shared cache, default 1,4,8\n"
+            "  --part-sizes-mb N,...  multipart part sizes of the multipart benchmark, default 4,8,16\n"
+            "  --part-threads N,...   multipart thread counts of the multipart benchmark, default 1,4,8\n"
+            "  --resolve-seconds N    duration of each resolve benchmark, default 2\n"
+            "  --repeat N             stage opens per asset set, default 3\n"
+            "  --compress N           1 stores the text layers gzip compressed with a Content-Encoding, default 0\n"
+            "  --startup-runs N       processes started to time the startup with and without plugins, default 5\n"
+            "  --index-records N      records in the cache index of the index startup benchmark, default 100000\n"
+            "  --output PATH          write the results to PATH instead of stdout\n",
+            program);
+    }
+
+    bool parse_options(int argc, char** argv, Options& options) {
+        options = Options{{20.0, 1000.0, 0.0, 500.0}, 200, 50, 4, 32 << 20, {1, 2, 4, 8, 16}, {1, 4, 8}, {4 << 20, 8 << 20, 16 << 20}, {1, 4, 8}, 2.0, 3, false, 5, 100000, "", ""};
+        for (int i = 1; i < argc; ++i) {
+            const std::string option = argv[i];
+            if (i + 1 >= argc) {
+                return false;
+            }
+            const std::string value = argv[++i];
+            if (option == "--latency-ms") {
+                options.profile.latency_ms = std::atof(value.c_str());
+            } else if (option == "--bandwidth-mbps") {
+                options.profile.bandwidth_mbps = std::atof(value.c_str());
+            } else if (option == "--slow-fraction") {
+                options.profile.slow_fraction = std::atof(value.c_str());
+            } else if (option == "--slow-latency-ms") {
+                options.profile.slow_latency_ms = std::atof(value.c_str());
+            } else if (option == "--small-layers") {
+                options.small_layers = std::strtoull(value.c_str(), nullptr, 10);
+            } else if (option == "--chain-depth") {
+                options.chain_depth = std::max<size_t>(1, std::strtoull(value.c_str(), nullptr, 10));
+            } else if (option == "--large-packages") {
+                options.large_packages = std::strtoull(value.c_str(), nullptr, 10);
+            } else if (option == "--large-size-mb") {
+                options.large_package_size = std::strtoull(value.c_str(), nullptr, 10) << 20;
+            } else if (option == "--threads") {
+                options.thread_counts.clear();
+                for (const auto& count : TfStringSplit(value, ",")) {
+                    options.thread_counts.push_back(std::max(1, atoi(count.c_str())));
+                }
+            } else if (option == "--processes") {
+                options.process_counts.clear();
+                for (const auto& count : TfStringSplit(value, ",")) {
+                    options.process_counts.push_back(std::max(1, atoi(count.c_str())));
+                }
+            } else if (option == "--part-sizes-mb") {
+                options.part_sizes.clear();
+                for (const auto& size : TfStringSplit(value, ",")) {
+                    options.part_sizes.push_back(std::max<size_t>(1, std::strtoull(size.c_str(), nullptr, 10)) << 20);
+                }
+            } else if (option == "--part-threads") {
+                options.part_thread_counts.clear();
+                for (const auto& count : TfStringSplit(value, ",")) {
+                    options.part_thread_counts.push_back(std::max(1, atoi(count.c_str())));
+                }
+            } else if (option == "--resolve-seconds") {
+                options.resolve_seconds = std::atof(value.c_str());
+            } else if (option == "--repeat") {
+                options.repeat = std::max(1, atoi(value.c_str()));
+            } else if (option == "--compress") {
+                options.compress = atoi(value.c_str()) != 0;
+            } else if (option == "--startup-runs") {
+                options.startup_runs = std::max(0, atoi(value.c_str()));
+            } else if (option == "--index-records") {
+                options.index_records = std::strtoull(value.c_str(), nullptr, 10);
+            } else if (option == "--output") {
+                options.output = value;
+            } else if (option == STARTUP_PROBE_OPTION) {
+                options.startup_probe = value;
+            } else if (option == FETCH_PROBE_OPTION) {
+                options.fetch_probe = value;
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Open a stage and load everything, returns the time it took or a negative value on failure
+    double open_stage(const std::string& root) {
+        const auto start = Clock::now();
+        UsdStageRefPtr stage = UsdStage::Open(root, UsdStage::LoadAll);
+        const double seconds = seconds_since(start);
+        return stage ? seconds : -1.0;
+    }
+
+    // Start this program with args, e.g. as a startup or fetch probe, returns its pid or -1.
+    // The probe inherits the environment with the variables in overrides replaced,
+    // without plugins it runs with PXR_PLUGINPATH_NAME removed.
+    // The standard output of the probe goes to output_path if it isn't empty.
+    pid_t spawn_probe(const std::vector<std::string>& args, const std::vector<std::string>& overrides,
+            bool with_plugins, const std::string& output_path) {
+        std::vector<char*> environment;
+        for (char** variable = environ; *variable != nullptr; ++variable) {
+            const char* separator = strchr(*variable, '=');
+            const size_t name_length = separator != nullptr ? static_cast<size_t>(separator - *variable) + 1 : 0;
+            bool is_replaced = !with_plugins &&
+                strncmp(*variable, PLUGIN_PATH_VARIABLE, strlen(PLUGIN_PATH_VARIABLE)) == 0;
+            for (const auto& override_variable : overrides) {
+                is_replaced = is_replaced ||
+                    (name_length > 0 && override_variable.compare(0, name_length, *variable, name_length) == 0);
+            }
+            if (!is_replaced) {
+                environment.push_back(*variable);
+            }
+        }
+        for (const auto& override_variable : overrides) {
+            environment.push_back(const_cast<char*>(override_variable.c_str()));
+        }
+        environment.push_back(nullptr);
+        const std::string program = ArchGetExecutablePath();
+        std::vector<char*> argv = {const_cast<char*>(program.c_str())};
+        for (const auto& arg : args) {
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        }
+        argv.push_back(nullptr);
+        posix_spawn_file_actions_t file_actions;
+        posix_spawn_file_actions_init(&file_actions);
+        if (!output_path.empty()) {
+            posix_spawn_file_actions_addopen(&file_actions, STDOUT_FILENO, output_path.c_str(),
+                O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        }
+        pid_t pid;
+        const int error = posix_spawn(&pid, program.c_str(), &file_actions, nullptr, argv.data(), environment.data());
+        posix_spawn_file_actions_destroy(&file_actions);
+        return error == 0 ? pid : -1;
+    }
+
+    // Wait for a probe, returns whether it succeeded
+    bool wait_probe(pid_t pid) {
+        int status = 0;
+        return pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+    // Start this program as a probe that opens a local layer and exits, like usdcat of a local file.
+    // Returns the wall time of each run in milliseconds.
+    std::vector<double> measure_startups(const std::string& layer_path, bool with_plugins, int runs) {
+        std::vector<double> latencies;
+        for (int i = 0; i < runs; ++i) {
+            const auto start = Clock::now();
+            if (wait_probe(spawn_probe({STARTUP_PROBE_OPTION, layer_path}, {}, with_plugins, std::string()))) {
+                latencies.push_back(seconds_since(start) * 1000.0);
+            }
+        }
+        return latencies;
+    }
+
+    // Fetch the assets of a set in process_count fetch probes at the same time, all
+    // sharing one new cache directory. Returns the requests and the bytes the server
+    // sent for all of them together, or zeros if a probe failed.
+    std::pair<size_t, size_t> measure_shared_fetches(const usd_s3_benchmark::MockS3& server,
+            const usd_s3_benchmark::AssetSet& asset_set, int process_count, const std::string& cache_dir) {
+        const size_t requests = server.get_request_count();
+        const size_t bytes_sent = server.get_bytes_sent();
+        const std::vector<std::string> args = {FETCH_PROBE_OPTION, TfStringJoin(asset_set.assets, ";"),
+            "--threads", "4"};
+        std::vector<pid_t> pids;
+        for (int i = 0; i < process_count; ++i) {
+            pids.push_back(spawn_probe(args, {"USD_S3_CACHE_PATH=" + cache_dir}, true, "/dev/null"));
+        }
+        bool success = true;
+        for (const pid_t pid : pids) {
+            success = wait_probe(pid) && success;
+        }
+        if (!success) {
+            return std::make_pair(0, 0);
+        }
+        return std::make_pair(server.get_request_count() - requests, server.get_bytes_sent() - bytes_sent);
+    }
+
+    // Fetch an asset in a fetch probe with multipart settings, the settings are read once per process.
+    // part_size 0 downloads it with a single GET. Returns bytes per second or a negative value on failure.
+    double measure_multipart_fetch(const std::string& asset_path, size_t part_size, int thread_count,
+            const std::string& work_dir) {
+        const std::string cache_dir = TfStringPrintf("%s/multipart_%zu_%d", work_dir.c_str(), part_size, thread_count);
+        const std::string output_path = cache_dir + ".out";
+        const pid_t pid = spawn_probe({FETCH_PROBE_OPTION, asset_path, "--threads", "1"}, {
+            "USD_S3_CACHE_PATH=" + cache_dir,
+            TfStringPrintf("USD_S3_MULTIPART_THRESHOLD=%d", part_size > 0 ? 1 : 0),
+            TfStringPrintf("USD_S3_MULTIPART_PART_SIZE=%zu", std::max<size_t>(part_size, 1)),
+            TfStringPrintf("USD_S3_MULTIPART_THREADS=%d", thread_count)}, true, output_path);
+        double throughput = -1.0;
+        if (wait_probe(pid)) {
+            std::ifstream output(output_path.c_str());
+            output >> throughput;
+        }
+        TfRmTree(cache_dir);
+        std::remove(output_path.c_str());
+        return throughput;
+    }
+
+    // Write a cache index of record_count records to cache_dir, then open it again
+    // and look up one key, like the first resolve of a process with a large cache.
+    // Returns the milliseconds of the open and of the first lookup, or negative values on failure.
+    std::pair<double, double> measure_index_startup(const std::string& cache_dir, size_t record_count) {
+        {
+            usd_s3::CacheIndex index;
+            if (!index.open(cache_dir)) {
+                return std::make_pair(-1.0, -1.0);
+            }
+            for (size_t i = 0; i < record_count; ++i) {
+                const std::string key = TfStringPrintf("%s/index/object_%zu.usd", BUCKET, i);
+                index.store(usd_s3::IndexRecord{key, "", TfStringPrintf("\"%016zx\"", i), cache_dir + "/" + key,
+                    1.6e9, 1.6e9, 4096, false});
+            }
+        }
+        usd_s3::CacheIndex index;
+        auto start = Clock::now();
+        if (!index.open(cache_dir)) {
+            return std::make_pair(-1.0, -1.0);
+        }
+        const double open_ms = seconds_since(start) * 1000.0;
+        usd_s3::IndexRecord record;
+        start = Clock::now();
+        const bool found = index.find(TfStringPrintf("%s/index/object_%zu.usd", BUCKET, record_count / 2), record);
+        const double lookup_ms = seconds_since(start) * 1000.0;
+        return std::make_pair(open_ms, found ? lookup_ms : -1.0);
+    }
+
+    // Resolve the assets of a set round robin on a number of threads, returns resolves per second
+    double measure_resolves(const usd_s3_benchmark::AssetSet& asset_set, int thread_count, double duration) {
+        ArResolver& resolver = ArGetResolver();
+        std::atomic<bool> is_running(true);
+        std::atomic<size_t> resolves(0);
+        std::vector<std::thread> threads;
+        const auto start = Clock::now();
+        for (int i = 0; i < thread_count; ++i) {
+            threads.emplace_back([&, i]() {
+                size_t count = 0;
+                for (size_t j = static_cast<size_t>(i); is_running.load(std::memory_order_relaxed); ++j) {
+                    resolver.Resolve(asset_set.assets[j % asset_set.assets.size()]);
+                    ++count;
+                }
+                resolves += count;
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::duration<double>(duration));
+        is_running = false;
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        return static_cast<double>(resolves.load()) / seconds_since(start);
+    }
+
+    // Resolve one cached asset over and over on this thread, returns nanoseconds per resolve
+    double measure_resolve_latency(const std::string& path, size_t iterations) {
+        ArResolver& resolver = ArGetResolver();
+        resolver.Resolve(path);
+        const auto start = Clock::now();
+        for (size_t i = 0; i < iterations; ++i) {
+            resolver.Resolve(path);
+        }
+        return seconds_since(start) * 1e9 / static_cast<double>(iterations);
+    }
+
+    // Resolve and fetch the assets of a set on a number of threads, returns bytes per second
+    double measure_fetches(const usd_s3_benchmark::AssetSet& asset_set, int thread_count) {
+        ArResolver& resolver = ArGetResolver();
+        std::atomic<size_t> next(0);
+        std::atomic<size_t> bytes(0);
+        std::atomic<bool> failed(false);
+        std::vector<std::thread> threads;
+        const auto start = Clock::now();
+        for (int i = 0; i < thread_count; ++i) {
+            threads.emplace_back([&]() {
+                for (size_t j = next++; j < asset_set.assets.size(); j = next++) {
+                    const std::string& path = asset_set.assets[j];
+                    const std::string local_path = resolver.Resolve(path);
+                    struct stat local_stat;
+                    if (local_path.empty() || !resolver.FetchToLocalResolvedPath(path, local_path) ||
+                            stat(local_path.c_str(), &local_stat) != 0) {
+                        failed = true;
+                    } else {
+                        bytes += static_cast<size_t>(local_stat.st_size);
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        const double seconds = seconds_since(start);
+        return failed ? -1.0 : static_cast<double>(bytes.load()) / seconds;
+    }
+
+    // Fetch the resolved assets of a set one by one, returns the latency of each fetch in milliseconds
+    std::vector<double> measure_fetch_latencies(const usd_s3_benchmark::AssetSet& asset_set) {
+        ArResolver& resolver = ArGetResolver();
+        std::vector<std::string> local_paths;
+        for (const auto& path : asset_set.assets) {
+            local_paths.push_back(resolver.Resolve(path));
+        }
+        std::vector<double> latencies;
+        for (size_t i = 0; i < asset_set.assets.size(); ++i) {
+            const auto start = Clock::now();
+            if (!local_paths[i].empty() && resolver.FetchToLocalResolvedPath(asset_set.assets[i], local_paths[i])) {
+                latencies.push_back(seconds_since(start) * 1000.0);
+            }
+        }
+        return latencies;
+    }
+
+    // The value below which the quantile of the samples fall
+    double get_quantile(std::vector<double> samples, double quantile) {
+        if (samples.empty()) {
+            return -1.0;
+        }
+        std::sort(samples.begin(), samples.end());
+        const size_t index = static_cast<size_t>(std::ceil(quantile * static_cast<double>(samples.size()))) - 1;
+        return samples[std::min(index, samples.size() - 1)];
+    }
+
+    std::string format_results(const Options& options, const std::vector<Result>& results,
+            const usd_s3_benchmark::MockS3& server, size_t cache_bytes) {
+        std::string out = "{\n  \"benchmark\": \"usd_s3\",\n";
+        const char* hedge_quantile = getenv("USD_S3_HEDGE_QUANTILE");
+        const char* cache_compression = getenv("USD_S3_CACHE_COMPRESSION");
+        out += TfStringPrintf("  \"config\": {\"latency_ms\": %g, \"bandwidth_mbps\": %g, \"slow_fraction\": %g, "
+            "\"slow_latency_ms\": %g, \"hedge_quantile\": %g, \"small_layers\": %zu, \"chain_depth\": %zu, "
+            "\"large_packages\": %zu, \"large_package_size\": %zu, \"repeat\": %d, \"compress\": %d, "
+            "\"cache_compression\": %d, \"startup_runs\": %d, \"index_records\": %zu},\n",
+            options.profile.latency_ms, options.profile.bandwidth_mbps, options.profile.slow_fraction,
+            options.profile.slow_latency_ms, hedge_quantile != nullptr ? std::atof(hedge_quantile) : 0.0,
+            options.small_layers, options.chain_depth, options.large_packages, options.large_package_size,
+            options.repeat, options.compress ? 1 : 0, cache_compression != nullptr ? atoi(cache_compression) : 0,
+            options.startup_runs, options.index_records);
+        out += "  \"results\": [";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Result& result = results[i];
+            out += i > 0 ? ",\n    " : "\n    ";
+            out += TfStringPrintf("{\"name\": \"%s\", \"asset_set\": \"%s\", \"threads\": %d, \"value\": %.6g, "
+                "\"unit\": \"%s\"}", result.name.c_str(), result.asset_set.c_str(), result.threads, result.value,
+                result.unit);
+        }
+        out += TfStringPrintf("\n  ],\n  \"requests\": %zu,\n  \"bytes_sent\": %zu,\n  \"peak_rss_kb\": %ld,\n"
+            "  \"cpu_seconds\": %.3f,\n  \"cache_bytes\": %zu\n}\n",
+            server.get_request_count(), server.get_bytes_sent(), get_peak_rss_kb(), get_cpu_seconds(), cache_bytes);
+        return out;
+    }
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    if (!options.startup_probe.empty()) {
+        return open_stage(options.startup_probe) < 0.0 ? 1 : 0;
+    }
+    if (!options.fetch_probe.empty()) {
+        // the settings of the parent process come with the environment, the throughput goes to stdout
+        ArSetPreferredResolver("S3Resolver");
+        usd_s3_benchmark::AssetSet asset_set{"fetch_probe", "", TfStringSplit(options.fetch_probe, ";"), 0};
+        const double throughput = measure_fetches(asset_set, options.thread_counts.front());
+        printf("%.6g\n", throughput);
+        return throughput < 0.0 ? 1 : 0;
+    }
+
+    usd_s3_benchmark::MockS3 server(options.profile);
+    if (!server.start()) {
+        fprintf(stderr, "failed to start the mock S3 server: %s\n", strerror(errno));
+        return 1;
+    }
+    server.set_compress_layers(options.compress);
+    char work_dir_template[] = "/tmp/usd_s3_benchmark_XXXXXX";
+    const char* work_dir = mkdtemp(work_dir_template);
+    if (work_dir == nullptr) {
+        fprintf(stderr, "failed to create a work directory: %s\n", strerror(errno));
+        return 1;
+    }
+
+    // startup of processes that only open local files, before the USD_S3_* variables
+    // are set, the plugin shouldn't add more than loading its libraries
+    std::vector<Result> results;
+    if (options.startup_runs > 0) {
+        const std::string layer_path = std::string(work_dir) + "/startup.usda";
+        {
+            std::ofstream layer(layer_path.c_str());
+            layer << "#usda 1.0\n\ndef Xform \"World\"\n{\n}\n";
+        }
+        for (const bool with_plugins : {true, false}) {
+            const auto latencies = measure_startups(layer_path, with_plugins, options.startup_runs);
+            results.push_back(Result{with_plugins ? "startup_with_plugins" : "startup_without_plugins",
+                "local_layer", 1, get_quantile(latencies, 0.5), "ms"});
+        }
+        fprintf(stderr, "startup done\n");
+    }
+
+    // a process with a large local cache opens the index on its first s3 path
+    if (options.index_records > 0) {
+        const std::string index_dir = std::string(work_dir) + "/index";
+        TfMakeDirs(index_dir);
+        const auto index_startup = measure_index_startup(index_dir, options.index_records);
+        const std::string asset_set = TfStringPrintf("index_%zu_records", options.index_records);
+        results.push_back(Result{"index_open", asset_set, 1, index_startup.first, "ms"});
+        results.push_back(Result{"index_first_lookup", asset_set, 1, index_startup.second, "ms"});
+        TfRmTree(index_dir);
+        fprintf(stderr, "index startup done\n");
+    }
+
+    // the resolver reads its settings on the first s3 path it sees, other USD_S3_* variables are left as they are
+    const std::string cache_path = std::string(work_dir) + "/cache";
+    setenv("USD_S3_ENDPOINT", server.get_endpoint().c_str(), 1);
+    setenv("USD_S3_CACHE_PATH", cache_path.c_str(), 1);
+    setenv("USD_S3_REGION", "us-east-1", 0);
+    // the mock server doesn't check signatures, any credentials will do
+    setenv("AWS_ACCESS_KEY_ID", "benchmark", 1);
+    setenv("AWS_SECRET_ACCESS_KEY", "benchmark", 1);
+    setenv("AWS_EC2_METADATA_DISABLED", "true", 1);
+    ArSetPreferredResolver("S3Resolver");
+    ArResolver& resolver = ArGetResolver();
+
+    int run = 0;
+    auto make_prefix = [&run]() {
+        return TfStringPrintf("run_%d/", run++);
+    };
+    auto make_set = [&](const std::string& name, const std::string& prefix) {
+        if (name == "small_layers") {
+            return usd_s3_benchmark::make_small_layers(server, BUCKET, prefix, options.small_layers);
+        } else if (name == "reference_chain") {
+            return usd_s3_benchmark::make_reference_chain(server, BUCKET, prefix, options.chain_depth);
+        }
+        return usd_s3_benchmark::make_large_packages(server, BUCKET, prefix, options.large_packages,
+            options.large_package_size, work_dir);
+    };
+
+    // check that the s3 paths end up in the cache of the S3Resolver
+    {
+        const auto asset_set = usd_s3_benchmark::make_reference_chain(server, BUCKET, make_prefix(), 1);
+        const std::string local_path = resolver.Resolve(asset_set.root);
+        if (local_path.compare(0, cache_path.size(), cache_path) != 0) {
+            fprintf(stderr, "%s resolved to '%s', is the S3Resolver in PXR_PLUGINPATH_NAME?\n",
+                asset_set.root.c_str(), local_path.c_str());
+            TfRmTree(work_dir);
+            return 1;
+        }
+    }
+
+    // cold opens use a fresh copy of the assets under a new prefix, warm opens reopen the last copy
+    usd_s3_benchmark::AssetSet small_layers;
+    for (const char* name : {"small_layers", "reference_chain", "large_packages"}) {
+        if ((strcmp(name, "large_packages") == 0 && options.large_packages == 0) ||
+                (strcmp(name, "small_layers") == 0 && options.small_layers == 0)) {
+            continue;
+        }
+        usd_s3_benchmark::AssetSet asset_set;
+        // CPU time of the opens, without building the sets
+        double cpu_seconds = 0.0;
+        for (int i = 0; i < options.repeat; ++i) {
+            asset_set = make_set(name, make_prefix());
+            const double cpu_start = get_cpu_seconds();
+            results.push_back(Result{"stage_open_cold", name, 1, open_stage(asset_set.root), "s"});
+            cpu_seconds += get_cpu_seconds() - cpu_start;
+        }
+        const double cpu_start = get_cpu_seconds();
+        for (int i = 0; i < options.repeat; ++i) {
+            results.push_back(Result{"stage_open_warm", name, 1, open_stage(asset_set.root), "s"});
+        }
+        cpu_seconds += get_cpu_seconds() - cpu_start;
+        results.push_back(Result{"stage_open_cpu", name, 1, cpu_seconds / (2.0 * options.repeat), "s"});
+        results.push_back(Result{"asset_bytes", name, 1, static_cast<double>(asset_set.bytes), "B"});
+        if (asset_set.name == "small_layers") {
+            small_layers = asset_set;
+        }
+        fprintf(stderr, "%s done\n", name);
+    }
+
+    // resolves of assets that are in the resolver's cache
+    if (!small_layers.assets.empty()) {
+        results.push_back(Result{"resolve_latency", small_layers.name, 1,
+            measure_resolve_latency(small_layers.root, RESOLVE_LATENCY_ITERATIONS), "ns"});
+        for (const int thread_count : options.thread_counts) {
+            results.push_back(Result{"resolve_rate", small_layers.name, thread_count,
+                measure_resolves(small_layers, thread_count, options.resolve_seconds), "1/s"});
+        }
+        fprintf(stderr, "resolve_rate done\n");
+    }
+
+    // latency distribution of single downloads, the tail shows the slow responses
+    if (options.small_layers > 0) {
+        const auto latencies = measure_fetch_latencies(make_set("small_layers", make_prefix()));
+        for (const double quantile : {0.5, 0.99}) {
+            results.push_back(Result{TfStringPrintf("fetch_latency_p%g", quantile * 100.0), "small_layers", 1,
+                get_quantile(latencies, quantile), "ms"});
+        }
+        fprintf(stderr, "fetch_latency done\n");
+    }
+
+    // origin traffic of several processes fetching the same assets into one shared cache,
+    // the downloads of one process are used by the others, so it should stay flat
+    if (options.small_layers > 0) {
+        const auto asset_set = make_set("small_layers", make_prefix());
+        for (const int process_count : options.process_counts) {
+            const std::string shared_cache = TfStringPrintf("%s/shared_%d", work_dir, process_count);
+            const auto traffic = measure_shared_fetches(server, asset_set, process_count, shared_cache);
+            results.push_back(Result{"shared_cache_requests", asset_set.name, process_count,
+                static_cast<double>(traffic.first), "1"});
+            results.push_back(Result{"shared_cache_bytes_sent", asset_set.name, process_count,
+                static_cast<double>(traffic.second), "B"});
+        }
+        fprintf(stderr, "shared_cache done\n");
+    }
+
+    // downloads of fresh copies of the large packages, one by one and all at once
+    if (options.large_packages > 0) {
+        const int max_threads = static_cast<int>(options.large_packages);
+        for (const int thread_count : {1, max_threads}) {
+            auto asset_set = make_set("large_packages", make_prefix());
+            // only the packages, not the root layer
+            asset_set.assets.erase(asset_set.assets.begin());
+            results.push_back(Result{"fetch_throughput", asset_set.name, thread_count,
+                measure_fetches(asset_set, thread_count), "B/s"});
+        }
+        fprintf(stderr, "fetch_throughput done\n");
+
+        // one package with every part size and thread count, each in a new process and cache
+        auto asset_set = usd_s3_benchmark::make_large_packages(server, BUCKET, make_prefix(), 1,
+            options.large_package_size, work_dir);
+        if (asset_set.assets.size() > 1) {
+            const std::string& package = asset_set.assets[1];
+            results.push_back(Result{"multipart_throughput", "large_package_single_get", 1,
+                measure_multipart_fetch(package, 0, 1, work_dir), "B/s"});
+            for (const size_t part_size : options.part_sizes) {
+                for (const int thread_count : options.part_thread_counts) {
+                    results.push_back(Result{"multipart_throughput",
+                        TfStringPrintf("large_package_part_%zuMiB", part_size >> 20), thread_count,
+                        measure_multipart_fetch(package, part_size, thread_count, work_dir), "B/s"});
+                }
+            }
+        }
+        fprintf(stderr, "multipart_throughput done\n");
+    }
+
+    const std::string report = format_results(options, results, server, get_directory_bytes(cache_path));
+    if (options.output.empty()) {
+        std::cout << report;
+    } else {
+        std::ofstream file(options.output.c_str());
+        file << report;
+        if (!file) {
+            fprintf(stderr, "failed to write %s\n", options.output.c_str());
+        }
+    }
+    server.stop();
+    TfRmTree(work_dir);
+    return 0;
+}
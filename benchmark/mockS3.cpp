@@ -0,0 +1,506 @@
+#include "mockS3.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <random>
+
+#include <zlib.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+    // Bodies are sent in chunks of this size, the bandwidth limit is applied per chunk
+    constexpr size_t SEND_CHUNK_SIZE = 64 * 1024;
+    // Listings return at most this many objects per page, like S3
+    constexpr size_t MAX_LIST_KEYS = 1000;
+    // Requests with larger headers are rejected
+    constexpr size_t MAX_HEADER_SIZE = 64 * 1024;
+
+    std::string format_time(time_t time, const char* format) {
+        struct tm utc;
+        gmtime_r(&time, &utc);
+        char buffer[64];
+        strftime(buffer, sizeof(buffer), format, &utc);
+        return buffer;
+    }
+
+    // Compress content into the gzip format, returns an empty string on failure
+    std::string gzip(const std::string& content) {
+        z_stream stream = {};
+        // window bits of a gzip stream for zlib
+        if (deflateInit2(&stream, 6, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return std::string();
+        }
+        std::string compressed(deflateBound(&stream, static_cast<uLong>(content.size())), '\0');
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(content.data()));
+        stream.avail_in = static_cast<uInt>(content.size());
+        stream.next_out = reinterpret_cast<Bytef*>(&compressed[0]);
+        stream.avail_out = static_cast<uInt>(compressed.size());
+        const bool is_done = deflate(&stream, Z_FINISH) == Z_STREAM_END;
+        compressed.resize(stream.total_out);
+        deflateEnd(&stream);
+        return is_done ? compressed : std::string();
+    }
+
+    std::string to_lower(std::string value) {
+        std::transform(value.begin(), value.end(), value.begin(), [](char c) {
+            return static_cast<char>(tolower(static_cast<unsigned char>(c)));
+        });
+        return value;
+    }
+
+    std::string trim(const std::string& value) {
+        const size_t begin = value.find_first_not_of(" \t");
+        if (begin == std::string::npos) {
+            return std::string();
+        }
+        return value.substr(begin, value.find_last_not_of(" \t\r") - begin + 1);
+    }
+
+    // Decode the percent escapes of a url path or query value
+    std::string url_decode(const std::string& value, bool plus_is_space) {
+        std::string decoded;
+        decoded.reserve(value.size());
+        for (size_t i = 0; i < value.size(); ++i) {
+            if (value[i] == '%' && i + 2 < value.size() && isxdigit(static_cast<unsigned char>(value[i + 1])) &&
+                    isxdigit(static_cast<unsigned char>(value[i + 2]))) {
+                decoded += static_cast<char>(std::strtol(value.substr(i + 1, 2).c_str(), nullptr, 16));
+                i += 2;
+            } else if (value[i] == '+' && plus_is_space) {
+                decoded += ' ';
+            } else {
+                decoded += value[i];
+            }
+        }
+        return decoded;
+    }
+
+    // Get a parameter of a query string, or an empty string if it is absent
+    std::string get_query_param(const std::string& query, const std::string& name) {
+        size_t begin = 0;
+        while (begin <= query.size()) {
+            size_t end = query.find('&', begin);
+            if (end == std::string::npos) {
+                end = query.size();
+            }
+            const std::string param = query.substr(begin, end - begin);
+            const size_t separator = param.find('=');
+            if (param.substr(0, separator) == name) {
+                return separator == std::string::npos ? std::string() : url_decode(param.substr(separator + 1), true);
+            }
+            begin = end + 1;
+        }
+        return std::string();
+    }
+
+    bool has_query_param(const std::string& query, const std::string& name) {
+        return ("&" + query).find("&" + name + "=") != std::string::npos ||
+            ("&" + query + "&").find("&" + name + "&") != std::string::npos;
+    }
+
+    std::string xml_escape(const std::string& value) {
+        std::string escaped;
+        for (const char c : value) {
+            switch (c) {
+                case '&': escaped += "&amp;"; break;
+                case '<': escaped += "&lt;"; break;
+                case '>': escaped += "&gt;"; break;
+                case '"': escaped += "&quot;"; break;
+                default: escaped += c;
+            }
+        }
+        return escaped;
+    }
+
+    // FNV-1a of the content, stands in for the MD5 ETag of S3
+    std::string make_etag(const std::string& content) {
+        uint64_t hash = 14695981039346656037ULL;
+        for (const char c : content) {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211ULL;
+        }
+        char buffer[40];
+        snprintf(buffer, sizeof(buffer), "\"%016llx\"", static_cast<unsigned long long>(hash));
+        return buffer;
+    }
+
+    const char* get_status_text(int status) {
+        switch (status) {
+            case 200: return "OK";
+            case 206: return "Partial Content";
+            case 304: return "Not Modified";
+            case 400: return "Bad Request";
+            case 404: return "Not Found";
+            case 405: return "Method Not Allowed";
+            case 416: return "Requested Range Not Satisfiable";
+            default: return "Internal Server Error";
+        }
+    }
+
+    std::string make_error(const char* code, const char* message) {
+        return std::string("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<Error><Code>") + code +
+            "</Code><Message>" + message + "</Message></Error>";
+    }
+}
+
+namespace usd_s3_benchmark {
+    MockS3::MockS3(const NetworkProfile& network_profile)
+        : profile(network_profile), listen_fd(-1), port(0), is_running(false), compress_layers(false),
+            request_count(0), bytes_sent(0) {
+    }
+
+    MockS3::~MockS3() {
+        stop();
+    }
+
+    bool MockS3::start() {
+        listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listen_fd < 0) {
+            return false;
+        }
+        const int enable = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+        sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = 0;
+        socklen_t address_length = sizeof(address);
+        if (bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+                listen(listen_fd, 128) != 0 ||
+                getsockname(listen_fd, reinterpret_cast<sockaddr*>(&address), &address_length) != 0) {
+            close(listen_fd);
+            listen_fd = -1;
+            return false;
+        }
+        port = ntohs(address.sin_port);
+        is_running = true;
+        acceptor = std::thread(&MockS3::accept_connections, this);
+        return true;
+    }
+
+    void MockS3::stop() {
+        if (!is_running.exchange(false)) {
+            return;
+        }
+        // wakes up accept and the blocking reads of the connections
+        shutdown(listen_fd, SHUT_RDWR);
+        acceptor.join();
+        close(listen_fd);
+        listen_fd = -1;
+        std::vector<std::thread> threads;
+        {
+            std::lock_guard<std::mutex> lock(connections_mutex);
+            for (const int fd : connection_fds) {
+                shutdown(fd, SHUT_RDWR);
+            }
+            threads.swap(connections);
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    std::string MockS3::get_endpoint() const {
+        return "http://127.0.0.1:" + std::to_string(port);
+    }
+
+    void MockS3::set_compress_layers(bool compress) {
+        compress_layers = compress;
+    }
+
+    void MockS3::put_object(const std::string& bucket, const std::string& key, const std::string& content) {
+        const time_t modified = time(nullptr);
+        const bool is_text_layer = key.size() > 5 && key.compare(key.size() - 5, 5, ".usda") == 0;
+        const std::string compressed = compress_layers && is_text_layer ? gzip(content) : std::string();
+        const std::string& stored = compressed.empty() ? content : compressed;
+        Object object{std::make_shared<const std::string>(stored), make_etag(stored),
+            format_time(modified, "%a, %d %b %Y %H:%M:%S GMT"), format_time(modified, "%Y-%m-%dT%H:%M:%S.000Z"),
+            compressed.empty() ? "" : "gzip"};
+        std::lock_guard<std::mutex> lock(objects_mutex);
+        objects[bucket + "/" + key] = object;
+    }
+
+    size_t MockS3::get_request_count() const {
+        return request_count.load();
+    }
+
+    size_t MockS3::get_bytes_sent() const {
+        return bytes_sent.load();
+    }
+
+    void MockS3::accept_connections() {
+        while (is_running) {
+            const int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                break;
+            }
+            const int enable = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+            std::lock_guard<std::mutex> lock(connections_mutex);
+            if (!is_running) {
+                close(fd);
+                break;
+            }
+            connection_fds.push_back(fd);
+            connections.emplace_back(&MockS3::serve_connection, this, fd);
+        }
+    }
+
+    void MockS3::serve_connection(int fd) {
+        std::string buffer;
+        Request request;
+        while (is_running && read_request(fd, buffer, request)) {
+            ++request_count;
+            handle_request(fd, request);
+            if (to_lower(request.headers["connection"]) == "close") {
+                break;
+            }
+        }
+        std::lock_guard<std::mutex> lock(connections_mutex);
+        connection_fds.erase(std::remove(connection_fds.begin(), connection_fds.end(), fd), connection_fds.end());
+        close(fd);
+    }
+
+    // Read the next request of a connection, buffer keeps the bytes read past it
+    bool MockS3::read_request(int fd, std::string& buffer, Request& request) {
+        size_t header_end;
+        while ((header_end = buffer.find("\r\n\r\n")) == std::string::npos) {
+            if (buffer.size() > MAX_HEADER_SIZE) {
+                return false;
+            }
+            char chunk[4096];
+            const ssize_t count = recv(fd, chunk, sizeof(chunk), 0);
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count <= 0) {
+                return false;
+            }
+            buffer.append(chunk, static_cast<size_t>(count));
+        }
+
+        request = Request();
+        const std::string head = buffer.substr(0, header_end);
+        buffer.erase(0, header_end + 4);
+        size_t line_end = head.find("\r\n");
+        const std::string request_line = head.substr(0, line_end);
+        const size_t method_end = request_line.find(' ');
+        const size_t target_end = request_line.find(' ', method_end + 1);
+        if (method_end == std::string::npos || target_end == std::string::npos) {
+            return false;
+        }
+        request.method = request_line.substr(0, method_end);
+        const std::string target = request_line.substr(method_end + 1, target_end - method_end - 1);
+        const size_t query_begin = target.find('?');
+        request.path = url_decode(target.substr(0, query_begin), false);
+        request.query = query_begin == std::string::npos ? std::string() : target.substr(query_begin + 1);
+
+        while (line_end != std::string::npos) {
+            const size_t line_begin = line_end + 2;
+            line_end = head.find("\r\n", line_begin);
+            const std::string line = head.substr(line_begin,
+                line_end == std::string::npos ? std::string::npos : line_end - line_begin);
+            const size_t separator = line.find(':');
+            if (separator != std::string::npos) {
+                request.headers[to_lower(trim(line.substr(0, separator)))] = trim(line.substr(separator + 1));
+            }
+        }
+
+        // requests of the resolver have no body, skip any that comes along
+        size_t body_length = std::strtoull(request.headers["content-length"].c_str(), nullptr, 10);
+        while (body_length > 0) {
+            if (buffer.empty()) {
+                char chunk[4096];
+                const ssize_t count = recv(fd, chunk, std::min(sizeof(chunk), body_length), 0);
+                if (count <= 0) {
+                    return false;
+                }
+                buffer.append(chunk, static_cast<size_t>(count));
+            }
+            const size_t skipped = std::min(body_length, buffer.size());
+            buffer.erase(0, skipped);
+            body_length -= skipped;
+        }
+        return true;
+    }
+
+    void MockS3::handle_request(int fd, const Request& request) {
+        thread_local std::mt19937 random(std::random_device{}());
+        const bool is_slow = profile.slow_fraction > 0.0 &&
+            std::uniform_real_distribution<double>(0.0, 1.0)(random) < profile.slow_fraction;
+        const double latency_ms = is_slow ? profile.slow_latency_ms : profile.latency_ms;
+        if (latency_ms > 0.0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(static_cast<int64_t>(latency_ms * 1000.0)));
+        }
+        const bool is_head = request.method == "HEAD";
+        if (!is_head && request.method != "GET") {
+            const std::string body = make_error("MethodNotAllowed", "Only HEAD and GET are supported.");
+            send_response(fd, 405, "Content-Type: application/xml\r\n", body.data(), body.size(), true);
+            return;
+        }
+
+        // path style addressing, /bucket/key
+        const size_t bucket_end = request.path.find('/', 1);
+        const std::string bucket = request.path.substr(1, bucket_end == std::string::npos ?
+            std::string::npos : bucket_end - 1);
+        const std::string key = bucket_end == std::string::npos ? std::string() : request.path.substr(bucket_end + 1);
+        if (key.empty()) {
+            if (!is_head && has_query_param(request.query, "list-type")) {
+                handle_list(fd, request, bucket);
+            } else {
+                const std::string body = make_error("InvalidRequest", "Only ListObjectsV2 is supported on buckets.");
+                send_response(fd, 400, "Content-Type: application/xml\r\n", body.data(), body.size(), !is_head);
+            }
+            return;
+        }
+
+        Object object;
+        {
+            std::lock_guard<std::mutex> lock(objects_mutex);
+            const auto it = objects.find(bucket + "/" + key);
+            if (it == objects.end()) {
+                const std::string body = make_error("NoSuchKey", "The specified key does not exist.");
+                send_response(fd, 404, "Content-Type: application/xml\r\n", body.data(), body.size(), !is_head);
+                return;
+            }
+            object = it->second;
+        }
+
+        const std::string object_headers = "ETag: " + object.etag + "\r\nLast-Modified: " + object.last_modified +
+            "\r\nAccept-Ranges: bytes\r\nContent-Type: application/octet-stream\r\n" +
+            (object.content_encoding.empty() ? "" : "Content-Encoding: " + object.content_encoding + "\r\n");
+        const auto if_none_match = request.headers.find("if-none-match");
+        if (if_none_match != request.headers.end() && if_none_match->second == object.etag) {
+            send_response(fd, 304, object_headers, nullptr, 0, false);
+            return;
+        }
+
+        const std::string& content = *object.content;
+        const auto range = request.headers.find("range");
+        if (range != request.headers.end() && range->second.compare(0, 6, "bytes=") == 0) {
+            const std::string spec = range->second.substr(6);
+            const size_t dash = spec.find('-');
+            const size_t first = std::strtoull(spec.substr(0, dash).c_str(), nullptr, 10);
+            size_t last = dash == std::string::npos || dash + 1 == spec.size() ? content.size() - 1 :
+                std::strtoull(spec.substr(dash + 1).c_str(), nullptr, 10);
+            last = std::min(last, content.size() - 1);
+            if (content.empty() || first > last) {
+                send_response(fd, 416, object_headers + "Content-Range: bytes */" + std::to_string(content.size()) +
+                    "\r\n", nullptr, 0, false);
+                return;
+            }
+            send_response(fd, 206, object_headers + "Content-Range: bytes " + std::to_string(first) + "-" +
+                std::to_string(last) + "/" + std::to_string(content.size()) + "\r\n",
+                content.data() + first, last - first + 1, !is_head);
+            return;
+        }
+        send_response(fd, 200, object_headers, content.data(), content.size(), !is_head);
+    }
+
+    // ListObjectsV2, the continuation token is the last key of the previous page
+    void MockS3::handle_list(int fd, const Request& request, const std::string& bucket) {
+        const std::string prefix = get_query_param(request.query, "prefix");
+        const std::string token = get_query_param(request.query, "continuation-token");
+        const std::string max_keys_param = get_query_param(request.query, "max-keys");
+        const size_t max_keys = max_keys_param.empty() ? MAX_LIST_KEYS :
+            std::min(MAX_LIST_KEYS, static_cast<size_t>(std::strtoull(max_keys_param.c_str(), nullptr, 10)));
+        const std::string bucket_prefix = bucket + "/";
+
+        std::string contents;
+        std::string last_key;
+        size_t key_count = 0;
+        bool is_truncated = false;
+        {
+            std::lock_guard<std::mutex> lock(objects_mutex);
+            auto it = token.empty() ? objects.lower_bound(bucket_prefix + prefix) :
+                objects.upper_bound(bucket_prefix + token);
+            for (; it != objects.end() && it->first.compare(0, bucket_prefix.size() + prefix.size(),
+                    bucket_prefix + prefix) == 0; ++it) {
+                if (key_count == max_keys) {
+                    is_truncated = true;
+                    break;
+                }
+                last_key = it->first.substr(bucket_prefix.size());
+                contents += "<Contents><Key>" + xml_escape(last_key) + "</Key><LastModified>" +
+                    it->second.listed_date + "</LastModified><ETag>" + xml_escape(it->second.etag) +
+                    "</ETag><Size>" + std::to_string(it->second.content->size()) +
+                    "</Size><StorageClass>STANDARD</StorageClass></Contents>";
+                ++key_count;
+            }
+        }
+
+        std::string body = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            "<ListBucketResult xmlns=\"http://s3.amazonaws.com/doc/2006-03-01/\"><Name>" + xml_escape(bucket) +
+            "</Name><Prefix>" + xml_escape(prefix) + "</Prefix><KeyCount>" + std::to_string(key_count) +
+            "</KeyCount><MaxKeys>" + std::to_string(max_keys) + "</MaxKeys><IsTruncated>" +
+            (is_truncated ? "true" : "false") + "</IsTruncated>" + contents;
+        if (!token.empty()) {
+            body += "<ContinuationToken>" + xml_escape(token) + "</ContinuationToken>";
+        }
+        if (is_truncated) {
+            body += "<NextContinuationToken>" + xml_escape(last_key) + "</NextContinuationToken>";
+        }
+        body += "</ListBucketResult>";
+        send_response(fd, 200, "Content-Type: application/xml\r\n", body.data(), body.size(), true);
+    }
+
+    // Send a response, the body is throttled to the bandwidth of the network profile.
+    // HEAD responses carry the headers of the body without sending it.
+    bool MockS3::send_response(int fd, int status, const std::string& headers, const char* body, size_t length,
+            bool send_body) {
+        const std::string head = "HTTP/1.1 " + std::to_string(status) + " " + get_status_text(status) + "\r\n" +
+            "Date: " + format_time(time(nullptr), "%a, %d %b %Y %H:%M:%S GMT") + "\r\n" +
+            "Server: usd-s3-benchmark\r\nx-amz-request-id: " + std::to_string(request_count.load()) + "\r\n" +
+            headers + "Content-Length: " + std::to_string(length) + "\r\n\r\n";
+        const auto start = std::chrono::steady_clock::now();
+        size_t sent = 0;
+        auto send_all = [fd](const char* data, size_t size) {
+            while (size > 0) {
+                const ssize_t count = send(fd, data, size, MSG_NOSIGNAL);
+                if (count < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (count <= 0) {
+                    return false;
+                }
+                data += count;
+                size -= static_cast<size_t>(count);
+            }
+            return true;
+        };
+        if (!send_all(head.data(), head.size())) {
+            return false;
+        }
+        if (!send_body || body == nullptr) {
+            return true;
+        }
+        while (sent < length) {
+            const size_t chunk = std::min(SEND_CHUNK_SIZE, length - sent);
+            if (!send_all(body + sent, chunk)) {
+                return false;
+            }
+            sent += chunk;
+            bytes_sent += chunk;
+            if (profile.bandwidth_mbps > 0.0) {
+                const auto due = start + std::chrono::microseconds(
+                    static_cast<int64_t>(static_cast<double>(sent) * 8.0 / profile.bandwidth_mbps));
+                std::this_thread::sleep_until(due);
+            }
+        }
+        return true;
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef S3_BENCHMARK_MOCK_S3_H
+#define S3_BENCHMARK_MOCK_S3_H
+
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace usd_s3_benchmark {
+    // Delays injected into every response of the mock server
+    struct NetworkProfile {
+        double latency_ms;          // before the first byte of a response
+        double bandwidth_mbps;      // per connection, 0 is unlimited
+        double slow_fraction;       // fraction of the responses that are delayed further
+        double slow_latency_ms;     // latency of those slow responses, like a busy storage node
+    };
+
+    // An in-process stand-in for an S3 object store.
+    //
+    // Serves HEAD, GET (with Range and If-None-Match) and ListObjectsV2 for
+    // path style requests on 127.0.0.1, from objects kept in memory.
+    // Requests are not authenticated. Every connection runs on its own thread
+    // and is kept alive like the connections of the AWS SDK.
+    class MockS3 {
+    public:
+        explicit MockS3(const NetworkProfile& profile);
+        ~MockS3();
+
+        // Listen on an ephemeral port, returns false if the socket can't be set up
+        bool start();
+        void stop();
+
+        // Endpoint for USD_S3_ENDPOINT, e.g. http://127.0.0.1:40123
+        std::string get_endpoint() const;
+
+        // Store text layers put after this gzip compressed, with a Content-Encoding like
+        // `aws s3 cp --content-encoding gzip`
+        void set_compress_layers(bool compress);
+        void put_object(const std::string& bucket, const std::string& key, const std::string& content);
+        size_t get_request_count() const;
+        size_t get_bytes_sent() const;
+
+    private:
+        struct Object {
+            std::shared_ptr<const std::string> content;
+            std::string etag;
+            std::string last_modified;  // RFC 1123, for headers
+            std::string listed_date;    // ISO 8601, for listings
+            std::string content_encoding;
+        };
+
+        struct Request {
+            std::string method;
+            std::string path;
+            std::string query;
+            std::map<std::string, std::string> headers;    // lower case names
+        };
+
+        void accept_connections();
+        void serve_connection(int fd);
+        bool read_request(int fd, std::string& buffer, Request& request);
+        void handle_request(int fd, const Request& request);
+        void handle_list(int fd, const Request& request, const std::string& bucket);
+        bool send_response(int fd, int status, const std::string& headers, const char* body, size_t length,
+            bool send_body);
+
+        NetworkProfile profile;
+        int listen_fd;
+        int port;
+        std::atomic<bool> is_running;
+        std::thread acceptor;
+        std::mutex connections_mutex;
+        std::vector<std::thread> connections;
+        std::vector<int> connection_fds;
+
+        mutable std::mutex objects_mutex;
+        std::map<std::string, Object> objects;    // by bucket/key, sorted for listings
+        std::atomic<bool> compress_layers;
+        std::atomic<size_t> request_count;
+        std::atomic<size_t> bytes_sent;
+    };
+}
+
+#endif // S3_BENCHMARK_MOCK_S3_H